@@ -7,9 +7,9 @@ int main(void)
     int pid;
 
     /* open the devices for standard file descriptors */
-    syscall(SYS_open, "/dev/keyboard"); /* STDIN  */
-    syscall(SYS_open, "/dev/console");  /* STDOUT */
-    syscall(SYS_open, "/dev/console");  /* STDERR */
+    syscall(SYS_open, "/dev/tty");      /* STDIN  */
+    syscall(SYS_open, "/dev/tty");      /* STDOUT */
+    syscall(SYS_open, "/dev/tty");      /* STDERR */
 
     /* start the shell */
     pid = syscall(SYS_fork);
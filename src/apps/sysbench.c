@@ -0,0 +1,115 @@
+#include "unistd.h"
+#include "stdio.h"
+#include "stdint.h"
+#include "stddef.h"
+#include "sys/syscall.h"
+#include "sys/resource.h"
+#include "sys/tsc.h"
+#include "sys/ring.h"
+
+#define SYSBENCH_ITERATIONS 10000
+#define SYSBENCH_RING_ENTRIES 32
+
+typedef int (*syscall_fn_t)(int number, ...);
+
+/* Measures the round trip of a cheap syscall.
+ *
+ * @return The average number of cycles per syscall
+ */
+static uint32_t measure(syscall_fn_t fn)
+{
+    uint32_t i;
+    uint64_t start, end;
+    struct rusage usage;
+
+    /* warm up the caches and the TLB */
+    for (i = 0; i < SYSBENCH_ITERATIONS / 10; ++i) {
+        fn(SYS_getrusage, 0, &usage);
+    }
+
+    start = tsc_read();
+    for (i = 0; i < SYSBENCH_ITERATIONS; ++i) {
+        fn(SYS_getrusage, 0, &usage);
+    }
+    end = tsc_read();
+
+    /* the total fits in 32 bits, and there is no 64 bit division */
+    return (uint32_t) (end - start) / SYSBENCH_ITERATIONS;
+}
+
+/* Measures the same syscall submitted through the ring in batches.
+ *
+ * @return The average number of cycles per syscall, or 0 on failure
+ */
+static uint32_t measure_ring(struct ring *ring)
+{
+    uint32_t i, j;
+    uint64_t start, end;
+    struct rusage usage;
+    struct ring_sqe *sqe;
+
+    start = tsc_read();
+    for (i = 0; i < SYSBENCH_ITERATIONS; i += SYSBENCH_RING_ENTRIES) {
+        for (j = 0; j < SYSBENCH_RING_ENTRIES; ++j) {
+            sqe = ring_get_sqe(ring);
+            sqe->opcode = SYS_getrusage;
+            sqe->args[0] = 0;
+            sqe->args[1] = (uint32_t) &usage;
+            sqe->user_data = j;
+        }
+        if (ring_submit(ring) != SYSBENCH_RING_ENTRIES) {
+            return 0;
+        }
+        while (ring_peek_cqe(ring) != NULL) {
+            ring_cqe_seen(ring);
+        }
+    }
+    end = tsc_read();
+
+    return (uint32_t) (end - start) / i;
+}
+
+/* Measures reading the pid from the kdata page, for comparison.
+ *
+ * @return The average number of cycles per read
+ */
+static uint32_t measure_kdata(void)
+{
+    uint32_t i;
+    uint64_t start, end;
+    volatile uint32_t pid;
+
+    start = tsc_read();
+    for (i = 0; i < SYSBENCH_ITERATIONS; ++i) {
+        pid = getpid();
+    }
+    end = tsc_read();
+    (void) pid;
+
+    return (uint32_t) (end - start) / SYSBENCH_ITERATIONS;
+}
+
+int main(void)
+{
+    struct ring ring;
+
+    printf("syscall round trip, %u iterations\n", SYSBENCH_ITERATIONS);
+    printf("int 0xAE: %u cycles\n", measure(&syscall_int));
+
+    if (syscall_has_sysenter()) {
+        printf("sysenter: %u cycles\n", measure(&syscall_sysenter));
+    } else {
+        printf("sysenter: not supported\n");
+    }
+
+    if (ring_init(&ring, SYSBENCH_RING_ENTRIES) == 0) {
+        printf("ring, %u per batch: %u cycles\n", SYSBENCH_RING_ENTRIES,
+               measure_ring(&ring));
+    } else {
+        printf("ring: setup failed\n");
+    }
+
+    printf("getpid from the kdata page: %u cycles\n", measure_kdata());
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "unistd.h"
+#include "stdio.h"
+#include "stdint.h"
+#include "stddef.h"
+#include "sys/syscall.h"
+#include "sys/resource.h"
+
+#define TOP_MAX_PROCESSES   16
+#define TOP_DELAY_YIELDS    500 /* number of yields between two samples */
+
+struct sample {
+    uint32_t pid;
+    struct rusage usage;
+};
+typedef struct sample sample_t;
+
+/* Samples the resource usage of all processes, at most TOP_MAX_PROCESSES.
+ *
+ * @return The number of processes sampled
+ */
+static uint32_t take_sample(sample_t *samples)
+{
+    uint32_t pids[TOP_MAX_PROCESSES];
+    int i, num_pids;
+    uint32_t n = 0;
+
+    num_pids = syscall(SYS_getpids, pids, TOP_MAX_PROCESSES);
+    for (i = 0; i < num_pids; ++i) {
+        /* the process might have exited since the pids were read */
+        if (syscall(SYS_getrusage, pids[i], &samples[n].usage) == 0) {
+            samples[n].pid = pids[i];
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+static sample_t const *find_sample(sample_t const *samples, uint32_t n,
+                                   uint32_t pid)
+{
+    uint32_t i;
+    for (i = 0; i < n; ++i) {
+        if (samples[i].pid == pid) {
+            return samples + i;
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t cpu_time(sample_t const *now, sample_t const *before)
+{
+    uint32_t t = now->usage.utime + now->usage.stime;
+    if (before != NULL) {
+        t -= before->usage.utime + before->usage.stime;
+    }
+
+    return t;
+}
+
+static void print_samples(sample_t const *before, uint32_t num_before,
+                          sample_t const *now, uint32_t num_now)
+{
+    uint32_t i, total = 0, t;
+    sample_t const *b;
+
+    for (i = 0; i < num_now; ++i) {
+        b = find_sample(before, num_before, now[i].pid);
+        total += cpu_time(now + i, b);
+    }
+
+    printf("\nPID\t%%CPU\tUSER\tSYS\tVCSW\tIVCSW\n");
+    for (i = 0; i < num_now; ++i) {
+        b = find_sample(before, num_before, now[i].pid);
+        t = cpu_time(now + i, b);
+        printf("%u\t%u\t%u\t%u\t%u\t%u\n",
+               now[i].pid, total == 0 ? 0 : t * 100 / total,
+               now[i].usage.utime, now[i].usage.stime,
+               now[i].usage.nvcsw, now[i].usage.nivcsw);
+    }
+}
+
+int main(void)
+{
+    uint32_t i, num_before, num_now;
+    sample_t before[TOP_MAX_PROCESSES];
+    sample_t now[TOP_MAX_PROCESSES];
+
+    while (1) {
+        num_before = take_sample(before);
+        for (i = 0; i < TOP_DELAY_YIELDS; ++i) {
+            syscall(SYS_yield);
+        }
+        num_now = take_sample(now);
+
+        print_samples(before, num_before, now, num_now);
+    }
+
+    return 0;
+}
@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_FS
+
 #include "aefs.h"
 #include "string.h"
 #include "log.h"
@@ -48,30 +50,52 @@ static int aefs_getattr(vnode_t *vnode, vattr_t *attr)
     return 0;
 }
 
-static int aefs_read(vnode_t *vnode, void *buf, uint32_t count)
+/* @return The inode in the chain of the file's inodes that has block i */
+static aefs_inode_t *get_block_inode(aefs_inode_t *inode, uint32_t i)
 {
-    uint32_t i, read = 0, to_read;
+    uint32_t hops;
+    for (hops = i / AEFS_INODE_NUM_BLOCKS; hops > 0; --hops) {
+        inode = get_inode(inode->inode_tail);
+    }
+    return inode;
+}
+
+static int aefs_read(vnode_t *vnode, void *buf, uint32_t count,
+                     uint32_t offset)
+{
+    uint32_t size, i, block_offset, to_read, read = 0;
+    char *dst = buf;
     aefs_inode_t *inode = (aefs_inode_t *) vnode->v_data;
 
     if (!AEFS_INODE_IS_REG(inode)) {
         return -1;
     }
 
-    uint32_t size = minu(count, AEFS_INODE_SIZE(inode));
-    uint32_t blocks = div_ceil(size, AEFS_BLOCK_SIZE);
+    size = AEFS_INODE_SIZE(inode);
+    if (offset >= size) {
+        return 0;
+    }
+    count = minu(count, size - offset);
+
+    /* follow the inode chain to the first block without reading the blocks
+     * in front of it */
+    i = offset / AEFS_BLOCK_SIZE;
+    block_offset = offset % AEFS_BLOCK_SIZE;
+    aefs_inode_t *current = get_block_inode(inode, i);
 
-    aefs_inode_t *current = inode;
-    for (i = 0; i < blocks; ++i) {
-        if (i % AEFS_INODE_NUM_BLOCKS == 0 && i != 0) {
+    while (read < count) {
+        if (i % AEFS_INODE_NUM_BLOCKS == 0 && read != 0) {
             current = get_inode(current->inode_tail);
         }
 
-        to_read = minu(size, AEFS_BLOCK_SIZE);
-        memcpy(buf + read,
-               get_block(current->blocks[i % AEFS_INODE_NUM_BLOCKS]),
+        to_read = minu(count - read, AEFS_BLOCK_SIZE - block_offset);
+        memcpy(dst + read,
+               get_block(current->blocks[i % AEFS_INODE_NUM_BLOCKS])->data +
+               block_offset,
                to_read);
-        size -= to_read;
         read += to_read;
+        block_offset = 0;
+        ++i;
     }
 
     return read;
@@ -89,19 +113,13 @@ static int aefs_write(vnode_t *n, char const *s, size_t l)
     return -1;
 }
 
-static int aefs_lookup(vnode_t *dir, char const *name, vnode_t *res)
+/* the original format, every entry has to be compared */
+static int lookup_linear(aefs_inode_t *inode, char const *name,
+                         uint16_t *inode_id)
 {
     uint32_t i, j;
     aefs_block_t *block;
     aefs_direntry_t *entry;
-    aefs_inode_t *inode = (aefs_inode_t *) dir->v_data;
-
-    if (!AEFS_INODE_IS_DIR(inode)) {
-        log_error("aefs_lookup",
-                  "dir is not a directory, looking for name %s\n",
-                  name);
-        return -1;
-    }
 
     uint32_t num_blocks = div_ceil(AEFS_INODE_SIZE(inode), AEFS_BLOCK_SIZE);
 
@@ -115,8 +133,7 @@ static int aefs_lookup(vnode_t *dir, char const *name, vnode_t *res)
 
         for (j = 0; j < AEFS_DIRENTRIES_PER_BLOCK; ++j, ++entry) {
             if (strncmp(entry->name, name, AEFS_FILENAME_MAX_LEN) == 0) {
-                res->v_op = &vnodeops;
-                res->v_data = (uint32_t) get_inode(entry->inode_id);
+                *inode_id = entry->inode_id;
                 return 0;
             }
         }
@@ -125,6 +142,68 @@ static int aefs_lookup(vnode_t *dir, char const *name, vnode_t *res)
     return -1;
 }
 
+/* only the entries in the name's bucket are compared, see aefs.h */
+static int lookup_hashed(aefs_inode_t *inode, char const *name,
+                         uint16_t *inode_id)
+{
+    char const *dir;
+    aefs_dirheader_t const *header;
+    aefs_hdirentry_t const *entry;
+    uint32_t hash = AEFS_HASH_INIT, len, offset;
+
+    if (AEFS_INODE_SIZE(inode) < sizeof(aefs_dirheader_t)) {
+        return -1;
+    }
+
+    for (len = 0; name[len] != '\0'; ++len) {
+        hash = AEFS_HASH_STEP(hash, name[len]);
+    }
+
+    dir = get_block(inode->blocks[0])->data;
+    header = (aefs_dirheader_t const *) dir;
+    offset = ((uint32_t const *) (header + 1))
+                [hash & (header->num_buckets - 1)];
+
+    while (offset != 0) {
+        entry = (aefs_hdirentry_t const *) (dir + offset);
+        if (entry->hash == hash && entry->name_len == len &&
+            strncmp(entry->name, name, len) == 0) {
+            *inode_id = entry->inode_id;
+            return 0;
+        }
+        offset = entry->next;
+    }
+
+    return -1;
+}
+
+static int aefs_lookup(vnode_t *dir, char const *name, vnode_t *res)
+{
+    uint16_t inode_id;
+    int ret;
+    aefs_inode_t *inode = (aefs_inode_t *) dir->v_data;
+
+    if (!AEFS_INODE_IS_DIR(inode)) {
+        log_error("aefs_lookup",
+                  "dir is not a directory, looking for name %s\n",
+                  name);
+        return -1;
+    }
+
+    if (sb->features & AEFS_FEATURE_HASHED_DIRS) {
+        ret = lookup_hashed(inode, name, &inode_id);
+    } else {
+        ret = lookup_linear(inode, name, &inode_id);
+    }
+
+    if (ret == 0) {
+        res->v_op = &vnodeops;
+        res->v_data = (uint32_t) get_inode(inode_id);
+    }
+
+    return ret;
+}
+
 static int aefs_open(vnode_t *node)
 {
     UNUSED_ARGUMENT(node);
@@ -135,26 +214,16 @@ static int aefs_open(vnode_t *node)
 
 static int map_aefs_to_virtual_memory(uint32_t paddr, uint32_t size)
 {
-    uint32_t fs_vaddr, mapped_mem_size;
-    fs_vaddr = pdt_kernel_find_next_vaddr(size);
+    uint32_t fs_vaddr;
+    fs_vaddr = pdt_kernel_map_next(paddr, size, PAGING_PL0, PAGING_READ_ONLY);
     if (fs_vaddr == 0) {
         log_error("map_aefs_to_virtual_memory",
-                  "Could not find virtual memory in kernel for AEFS."
+                  "Could not map kernel memory for AEFS."
                   "fs_paddr: %X, fs_size: %u\n",
                   paddr, size);
         return 0;
     }
 
-    mapped_mem_size = pdt_map_kernel_memory(paddr, fs_vaddr, size,
-                          PAGING_PL0, PAGING_READ_ONLY);
-    if (mapped_mem_size < size) {
-        log_error("map_aefs_to_virtual_memory",
-                  "Could not map kernel memory for AEFS."
-                  "fs_paddr: %X, fs_vaddr: %X, fs_size: %u, mapped_size: %u\n",
-                  paddr, fs_vaddr, size, mapped_mem_size);
-        return 0;
-    }
-
     log_info("map_aefs_to_virtual_memory",
              "fs info: fs_vaddr: %X, fs_paddr: %X, fs_size: %u\n",
              fs_vaddr, fs_paddr, size);
@@ -196,7 +265,6 @@ uint32_t aefs_init(uint32_t paddr, uint32_t size, vfs_t *vfs)
 
     vfsops.vfs_root = &aefs_root;
 
-    vfs->vfs_next = NULL;
     vfs->vfs_op = &vfsops;
 
     return 0;
@@ -14,6 +14,10 @@
 
 #define AEFS_MAGIC_NUMBER 0xAE12AE34
 
+/* features in the superblock, an image without any uses the original
+ * format */
+#define AEFS_FEATURE_HASHED_DIRS 0x00000001
+
 /* sizeof(inode_t) == 16 bytes */
 struct aefs_inode {
     uint8_t type;
@@ -32,18 +36,53 @@ struct aefs_inode_list {
 } __attribute__((packed));
 typedef struct aefs_inode_list aefs_inode_list_t;
 
-/* sizeof(direntry_t) == 256 bytes */
+/* sizeof(direntry_t) == 256 bytes, the entries of a directory without
+ * AEFS_FEATURE_HASHED_DIRS */
 struct aefs_direntry {
     char name[AEFS_FILENAME_MAX_LEN];
     uint16_t inode_id;
 } __attribute__((packed));
 typedef struct aefs_direntry aefs_direntry_t;
 
+/* With AEFS_FEATURE_HASHED_DIRS a directory is a header, a table of hash
+ * buckets and the entries, each entry as long as its name needs. A bucket
+ * and the next field of an entry hold the offset in bytes of an entry from
+ * the start of the directory, 0 ends the chain. The blocks of a directory
+ * are consecutive, so an offset is found without walking the inode chain.
+ */
+
+/* sizeof(dirheader_t) == 8 bytes, followed by num_buckets uint32_t */
+struct aefs_dirheader {
+    uint32_t num_entries;
+    uint32_t num_buckets;   /* a power of two */
+} __attribute__((packed));
+typedef struct aefs_dirheader aefs_dirheader_t;
+
+/* sizeof(hdirentry_t) == 12 bytes, followed by the name */
+struct aefs_hdirentry {
+    uint32_t next;
+    uint32_t hash;
+    uint16_t inode_id;
+    uint8_t name_len;       /* not counting the NUL */
+    uint8_t padding;
+    char name[];            /* NUL-terminated */
+} __attribute__((packed));
+typedef struct aefs_hdirentry aefs_hdirentry_t;
+
+/* the entries are 4 byte aligned */
+#define AEFS_HDIRENTRY_SIZE(name_len) \
+    ((sizeof(aefs_hdirentry_t) + (name_len) + 1 + 3) & ~3)
+
+/* FNV-1a, hash = AEFS_HASH_STEP(hash, c) for every character of the name */
+#define AEFS_HASH_INIT 2166136261u
+#define AEFS_HASH_STEP(hash, c) (((hash) ^ (uint8_t) (c)) * 16777619u)
+
 /* sizeof(superblock_t) == 12 bytes */
 struct aefs_superblock {
     uint32_t magic_number;
     uint16_t num_inodes;
     uint16_t start_block;
+    uint32_t features;
 } __attribute__((packed));
 typedef struct aefs_superblock aefs_superblock_t;
 
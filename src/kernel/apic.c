@@ -0,0 +1,112 @@
+#include "apic.h"
+#include "paging.h"
+#include "interrupt.h"
+#include "common.h"
+#include "constants.h"
+#include "log.h"
+#include "stddef.h"
+
+/* Information about how to program the local APIC was found in the Intel
+ * manual, volume 3, chapter 10
+ */
+
+/* register offsets */
+#define APIC_ID         0x020
+#define APIC_EOI        0x0B0
+#define APIC_SVR        0x0F0
+#define APIC_ICR_LOW    0x300
+#define APIC_ICR_HIGH   0x310
+
+#define APIC_SVR_ENABLE         (1 << 8)
+
+#define APIC_ICR_FIXED          (0x0 << 8)
+#define APIC_ICR_INIT           (0x5 << 8)
+#define APIC_ICR_STARTUP        (0x6 << 8)
+#define APIC_ICR_PENDING        (1 << 12)
+#define APIC_ICR_ASSERT         (1 << 14)
+#define APIC_ICR_LEVEL          (1 << 15)
+#define APIC_ICR_ALL_BUT_SELF   (0x3 << 18)
+
+static volatile uint32_t *apic_regs = NULL;
+
+static uint32_t apic_read(uint32_t reg)
+{
+    return apic_regs[reg / 4];
+}
+
+static void apic_write(uint32_t reg, uint32_t value)
+{
+    apic_regs[reg / 4] = value;
+}
+
+static void apic_send_icr(uint32_t dest, uint32_t cmd)
+{
+    apic_write(APIC_ICR_HIGH, dest << 24);
+    apic_write(APIC_ICR_LOW, cmd);
+    while (apic_read(APIC_ICR_LOW) & APIC_ICR_PENDING) {
+        /* wait for the IPI to be sent */
+    }
+}
+
+static void apic_handle_spurious_interrupt(cpu_state_t cpu, idt_info_t info,
+                                           stack_state_t stack)
+{
+    /* spurious interrupts must not be acknowledged */
+    UNUSED_ARGUMENT(cpu);
+    UNUSED_ARGUMENT(info);
+    UNUSED_ARGUMENT(stack);
+}
+
+int apic_init(uint32_t paddr)
+{
+    uint32_t vaddr = pdt_kernel_map_next(paddr, FOUR_KB, PAGING_READ_WRITE,
+                                         PAGING_PL0);
+    if (vaddr == 0) {
+        log_error("apic_init", "Couldn't map the APIC at paddr %X\n", paddr);
+        return -1;
+    }
+
+    apic_regs = (volatile uint32_t *) vaddr;
+    register_interrupt_handler(APIC_SPURIOUS_INT_IDX,
+                               apic_handle_spurious_interrupt);
+    apic_enable();
+
+    return 0;
+}
+
+void apic_enable(void)
+{
+    apic_write(APIC_SVR, APIC_SVR_ENABLE | APIC_SPURIOUS_INT_IDX);
+}
+
+uint32_t apic_is_enabled(void)
+{
+    return apic_regs != NULL;
+}
+
+uint32_t apic_id(void)
+{
+    return apic_read(APIC_ID) >> 24;
+}
+
+void apic_eoi(void)
+{
+    apic_write(APIC_EOI, 0);
+}
+
+void apic_send_init(uint32_t apic_id)
+{
+    apic_send_icr(apic_id, APIC_ICR_INIT | APIC_ICR_ASSERT | APIC_ICR_LEVEL);
+}
+
+void apic_send_startup(uint32_t apic_id, uint32_t paddr)
+{
+    /* the AP starts executing in real mode at vector * 4 kB */
+    apic_send_icr(apic_id, APIC_ICR_STARTUP | ((paddr >> 12) & 0xFF));
+}
+
+void apic_send_to_others(uint32_t vector)
+{
+    apic_send_icr(0, APIC_ICR_ALL_BUT_SELF | APIC_ICR_FIXED | APIC_ICR_ASSERT |
+                     (vector & 0xFF));
+}
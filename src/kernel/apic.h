@@ -0,0 +1,28 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "stdint.h"
+
+#define APIC_TICK_INT_IDX       0x30 /* scheduler tick sent to the APs */
+#define APIC_TLB_INT_IDX        0x31 /* TLB shootdown, see paging.c */
+#define APIC_SPURIOUS_INT_IDX   0xFF
+
+/* Maps the local APIC registers at the given physical address and enables
+ * the local APIC of the calling (bootstrap) CPU.
+ */
+int apic_init(uint32_t paddr);
+
+/* Enables the local APIC of an application processor */
+void apic_enable(void);
+
+/* Returns 0 if apic_init hasn't been called yet */
+uint32_t apic_is_enabled(void);
+uint32_t apic_id(void);
+void apic_eoi(void);
+
+void apic_send_init(uint32_t apic_id);
+void apic_send_startup(uint32_t apic_id, uint32_t paddr);
+/* sends a fixed interrupt with the given vector to all CPUs except this */
+void apic_send_to_others(uint32_t vector);
+
+#endif /* APIC_H */
@@ -14,6 +14,10 @@
 /* kernel stack */
 #define KERNEL_STACK_SIZE FOUR_KB
 
+/* smp */
+#define SMP_MAX_CPUS            8
+#define SMP_TRAMPOLINE_PADDR    0x8000 /* must be 4 kB aligned and < 1 MB */
+
 /* interrupts */
 #define SYSCALL_INT_IDX 0xAE
 
@@ -0,0 +1,146 @@
+#include "dcache.h"
+#include "string.h"
+#include "spinlock.h"
+#include "stddef.h"
+
+/* The cache is a set associative table, an entry can only be in the set its
+ * hash maps to and a full set replaces its entries round robin. There is
+ * nothing to allocate and a lookup probes at most DCACHE_NUM_WAYS entries.
+ */
+#define DCACHE_NUM_SETS 128 /* must be a power of two */
+#define DCACHE_NUM_WAYS 4
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+struct dcache_entry {
+    uint32_t hash;
+    uint8_t valid;
+    uint8_t negative;
+    uint8_t len;
+    vnodeops_t *dir_op;
+    uint32_t dir_data;
+    vnode_t node;
+    char name[DCACHE_NAME_LEN];
+};
+typedef struct dcache_entry dcache_entry_t;
+
+struct dcache_set {
+    dcache_entry_t entries[DCACHE_NUM_WAYS];
+    uint32_t next;      /* the entry to replace next */
+};
+typedef struct dcache_set dcache_set_t;
+
+static dcache_set_t sets[DCACHE_NUM_SETS];
+static spinlock_t dcache_lock = SPINLOCK_INIT("dcache");
+
+static uint32_t dcache_hash(vnode_t const *dir, char const *name, uint32_t len)
+{
+    uint32_t i, hash = FNV_OFFSET_BASIS;
+
+    for (i = 0; i < len; ++i) {
+        hash = (hash ^ (uint8_t) name[i]) * FNV_PRIME;
+    }
+    hash = (hash ^ (uint32_t) dir->v_op) * FNV_PRIME;
+    hash = (hash ^ dir->v_data) * FNV_PRIME;
+
+    return hash;
+}
+
+static int dcache_matches(dcache_entry_t const *e, uint32_t hash,
+                          vnode_t const *dir, char const *name, uint32_t len)
+{
+    return e->valid && e->hash == hash && e->len == len &&
+           e->dir_op == dir->v_op && e->dir_data == dir->v_data &&
+           strncmp(e->name, name, len) == 0;
+}
+
+uint32_t dcache_lookup(vnode_t const *dir, char const *name, uint32_t len,
+                       vnode_t *res)
+{
+    uint32_t hash, flags, i, ret = DCACHE_MISS;
+    dcache_set_t *set;
+    dcache_entry_t *e;
+
+    if (len > DCACHE_NAME_LEN) {
+        return DCACHE_MISS;
+    }
+
+    hash = dcache_hash(dir, name, len);
+    set = &sets[hash % DCACHE_NUM_SETS];
+
+    flags = spin_lock_irqsave(&dcache_lock);
+    for (i = 0; i < DCACHE_NUM_WAYS; ++i) {
+        e = &set->entries[i];
+        if (dcache_matches(e, hash, dir, name, len)) {
+            if (e->negative) {
+                ret = DCACHE_NEGATIVE;
+            } else {
+                vnode_copy(&e->node, res);
+                ret = DCACHE_HIT;
+            }
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+
+    return ret;
+}
+
+void dcache_insert(vnode_t const *dir, char const *name, uint32_t len,
+                   vnode_t const *res)
+{
+    uint32_t hash, flags, i;
+    dcache_set_t *set;
+    dcache_entry_t *e = NULL;
+
+    if (len > DCACHE_NAME_LEN) {
+        return;
+    }
+
+    hash = dcache_hash(dir, name, len);
+    set = &sets[hash % DCACHE_NUM_SETS];
+
+    flags = spin_lock_irqsave(&dcache_lock);
+    for (i = 0; i < DCACHE_NUM_WAYS; ++i) {
+        /* another CPU might have cached the same name meanwhile */
+        if (!set->entries[i].valid ||
+            dcache_matches(&set->entries[i], hash, dir, name, len)) {
+            e = &set->entries[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        e = &set->entries[set->next];
+        set->next = (set->next + 1) % DCACHE_NUM_WAYS;
+    }
+
+    e->valid = 1;
+    e->hash = hash;
+    e->len = len;
+    e->dir_op = dir->v_op;
+    e->dir_data = dir->v_data;
+    memcpy(e->name, name, len);
+    if (res == NULL) {
+        e->negative = 1;
+    } else {
+        e->negative = 0;
+        e->node.v_op = res->v_op;
+        e->node.v_data = res->v_data;
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+}
+
+void dcache_purge(void)
+{
+    uint32_t flags, i, j;
+
+    flags = spin_lock_irqsave(&dcache_lock);
+    for (i = 0; i < DCACHE_NUM_SETS; ++i) {
+        for (j = 0; j < DCACHE_NUM_WAYS; ++j) {
+            sets[i].entries[j].valid = 0;
+        }
+        sets[i].next = 0;
+    }
+    spin_unlock_irqrestore(&dcache_lock, flags);
+}
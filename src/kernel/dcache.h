@@ -0,0 +1,33 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "stdint.h"
+#include "vnode.h"
+
+/* A cache of the results of vn_lookup, (directory vnode, name) -> vnode. Names
+ * that weren't found are cached as well (negative entries), so a missing file
+ * doesn't cost a directory scan either. Longer names are never cached.
+ */
+
+#define DCACHE_NAME_LEN 32
+
+#define DCACHE_HIT 0
+#define DCACHE_NEGATIVE 1
+#define DCACHE_MISS 2
+
+/* Looks up the name of length len (not NUL-terminated) in dir.
+ *
+ * @return DCACHE_HIT and the vnode in res, DCACHE_NEGATIVE if the name is
+ *         known not to exist or DCACHE_MISS
+ */
+uint32_t dcache_lookup(vnode_t const *dir, char const *name, uint32_t len,
+                       vnode_t *res);
+
+/* Caches the result of a lookup, res is NULL if the name wasn't found */
+void dcache_insert(vnode_t const *dir, char const *name, uint32_t len,
+                   vnode_t const *res);
+
+/* Forgets everything, e.g. when a file is added to a directory */
+void dcache_purge(void);
+
+#endif /* DCACHE_H */
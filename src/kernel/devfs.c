@@ -1,8 +1,11 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_FS
+
 #include "devfs.h"
 #include "common.h"
 #include "kmalloc.h"
 #include "log.h"
 #include "string.h"
+#include "dcache.h"
 
 struct devfs_inode {
     struct devfs_inode *next;
@@ -33,11 +36,13 @@ static int devfs_open(vnode_t *n)
 
     return -1;
 }
-static int devfs_read(vnode_t *node, void *buf, uint32_t count)
+static int devfs_read(vnode_t *node, void *buf, uint32_t count,
+                      uint32_t offset)
 {
     UNUSED_ARGUMENT(node);
     UNUSED_ARGUMENT(buf);
     UNUSED_ARGUMENT(count);
+    UNUSED_ARGUMENT(offset);
 
     return -1;
 }
@@ -118,15 +123,13 @@ int devfs_add_device(char const *path, vnode_t *node)
         return -1;
     }
 
-    inode->next = NULL;
+    inode->next = devices;
     inode->name = copy;
     inode->node = node;
 
-    if (devices == NULL) {
-        devices = inode;
-    } else {
-        devices->next = inode;
-    }
+    devices = inode;
+    /* the name might be cached as missing */
+    dcache_purge();
 
     return 0;
 }
@@ -3,6 +3,8 @@
 #include "common.h"
 #include "vfs.h"
 #include "log.h"
+#include "string.h"
+#include "spinlock.h"
 
 #define FB_MEMORY KERNEL_START_VADDR + 0x000B8000
 
@@ -14,89 +16,177 @@
 
 #define FB_HIGH_BYTE 14
 #define FB_LOW_BYTE 15
+#define FB_START_HIGH_BYTE 12
+#define FB_START_LOW_BYTE 13
+
+/* the text mode memory is 32 kB, more than enough for one screen */
+#define FB_MEMORY_ROWS ((32 * 1024) / (2 * FB_NUM_COLS))
 
 #define BLACK_ON_WHITE 0x0F
 
-#define TO_ADDRESS(row, col) (fb + 2 * (row * FB_NUM_COLS + col))
+#define FB_CELL(b) ((uint16_t) ((BLACK_ON_WHITE << 8) | (b)))
+#define FB_ALL_ROWS ((1 << FB_NUM_ROWS) - 1)
 
 #define FB_BACKSPACE_ASCII 8
 
-static uint8_t *fb = (uint8_t *) FB_MEMORY;
+/* fb_write_buf holds the lock for at most this many bytes at a time */
+#define FB_WRITE_CHUNK FB_NUM_COLS
+
+static uint16_t *fb = (uint16_t *) FB_MEMORY;
 static uint16_t cursor_pos;
 static vnodeops_t vnodeops;
 
-static uint8_t read_cell(uint32_t row, uint32_t col)
+/* All writes go to a shadow of the screen in RAM, fb_flush copies the dirty
+ * rows to the VGA memory, which is much slower to access. The shadow is a
+ * ring of rows, top_row is the shadow row shown at the top of the screen, so
+ * scrolling only has to move top_row.
+ */
+static uint16_t shadow[FB_NUM_ROWS * FB_NUM_COLS];
+static uint32_t top_row;
+static uint32_t dirty_rows; /* one bit per screen row */
+
+/* The screen is a window into the VGA memory that starts at start_row, the
+ * CRTC start address register. Scrolling moves the window down, the screen
+ * only has to be copied when the window reaches the end of the memory.
+ */
+static uint32_t start_row;
+static uint32_t shown_start_row;
+
+/* protects all of the above, the console is written from processes, the
+ * keyboard's echo and kernel printf, possibly on several CPUs */
+static spinlock_t fb_lock = SPINLOCK_INIT("fb");
+
+static uint16_t *shadow_row(uint32_t row)
 {
-    uint8_t *cell = TO_ADDRESS(row, col);
-    return *cell;
+    return shadow + ((top_row + row) % FB_NUM_ROWS) * FB_NUM_COLS;
 }
 
-static void write_cell(uint8_t *cell, uint8_t b)
+static void write_at(uint8_t b, uint32_t row, uint32_t col)
 {
-    cell[0] = b;
-    cell[1] = BLACK_ON_WHITE;
+    shadow_row(row)[col] = FB_CELL(b);
+    dirty_rows |= 1 << row;
 }
 
-static void write_at(uint8_t b, uint32_t row, uint32_t col)
+static void write_at_cursor(uint8_t b)
 {
-    uint8_t *cell = TO_ADDRESS(row, col);
-    write_cell(cell, b);
+    write_at(b, cursor_pos / FB_NUM_COLS, cursor_pos % FB_NUM_COLS);
 }
 
+static void clear_row(uint32_t row)
+{
+    uint32_t c;
+    uint16_t *cells = shadow_row(row);
+    for (c = 0; c < FB_NUM_COLS; ++c) {
+        cells[c] = FB_CELL(' ');
+    }
+    dirty_rows |= 1 << row;
+}
+
+static void set_start_address(uint16_t loc)
+{
+    outb(FB_CURSOR_INDEX_PORT, FB_START_HIGH_BYTE);
+    outb(FB_CURSOR_DATA_PORT, loc >> 8);
+    outb(FB_CURSOR_INDEX_PORT, FB_START_LOW_BYTE);
+    outb(FB_CURSOR_DATA_PORT, loc);
+}
 
 static void set_cursor(uint16_t loc)
 {
+    /* the cursor location is relative to the VGA memory, not the screen */
+    loc += start_row * FB_NUM_COLS;
     outb(FB_CURSOR_INDEX_PORT, FB_HIGH_BYTE);
     outb(FB_CURSOR_DATA_PORT, loc >> 8);
     outb(FB_CURSOR_INDEX_PORT, FB_LOW_BYTE);
     outb(FB_CURSOR_DATA_PORT, loc);
 }
 
+/* the cursor helpers only move cursor_pos, the callers update the hardware
+ * cursor once they're done */
 static void move_cursor_forward(void)
 {
     cursor_pos++;
-    set_cursor(cursor_pos);
 }
 
 static void move_cursor_back(void)
 {
     if (cursor_pos != 0) {
         cursor_pos--;
-        set_cursor(cursor_pos);
     }
 }
 
 static void move_cursor_down()
 {
     cursor_pos += FB_NUM_COLS;
-    set_cursor(cursor_pos);
 }
 
 static void move_cursor_start()
 {
     cursor_pos -= cursor_pos % FB_NUM_COLS;
-    set_cursor(cursor_pos);
 }
 
 static void scroll()
 {
-    uint32_t r, c;
-    for (r = 1; r < FB_NUM_ROWS; ++r) {
-        for (c = 0; c < FB_NUM_COLS; ++c) {
-            write_at(read_cell(r, c), r - 1, c);
+    top_row = (top_row + 1) % FB_NUM_ROWS;
+
+    if (start_row + FB_NUM_ROWS < FB_MEMORY_ROWS) {
+        /* the rows move up with the window, row 0 falls off the screen */
+        start_row++;
+        dirty_rows >>= 1;
+    } else {
+        /* wrap around, the whole screen has to be copied to the start */
+        start_row = 0;
+        dirty_rows = FB_ALL_ROWS;
+    }
+
+    clear_row(FB_NUM_ROWS - 1);
+}
+
+/* called with the lock held */
+static void flush(void)
+{
+    uint32_t r;
+
+    if (dirty_rows != 0) {
+        for (r = 0; r < FB_NUM_ROWS; ++r) {
+            if (dirty_rows & (1 << r)) {
+                memcpy(fb + (start_row + r) * FB_NUM_COLS, shadow_row(r),
+                       FB_NUM_COLS * sizeof(uint16_t));
+            }
         }
+        dirty_rows = 0;
     }
 
-    for (c = 0; c < FB_NUM_COLS; ++c) {
-        write_at(' ', FB_NUM_ROWS - 1, c);
+    /* pan only once the rows are in place */
+    if (start_row != shown_start_row) {
+        set_start_address(start_row * FB_NUM_COLS);
+        shown_start_row = start_row;
     }
 }
 
-void fb_put_b(uint8_t b)
+void fb_flush(void)
 {
-    if (b != '\n' && b != '\t' && b != FB_BACKSPACE_ASCII) {
-        uint8_t *cell = fb + 2 * cursor_pos;
-        write_cell(cell, b);
+    uint32_t flags = spin_lock_irqsave(&fb_lock);
+    flush();
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+static void scroll_if_needed(void)
+{
+    if (cursor_pos >= FB_NUM_COLS * FB_NUM_ROWS) {
+        scroll();
+        cursor_pos = (FB_NUM_ROWS - 1) * FB_NUM_COLS;
+    }
+}
+
+static int is_special(uint8_t b)
+{
+    return b == '\n' || b == '\t' || b == FB_BACKSPACE_ASCII;
+}
+
+static void put_b(uint8_t b)
+{
+    if (!is_special(b)) {
+        write_at_cursor(b);
     }
 
     if (b == '\n') {
@@ -104,28 +194,89 @@ void fb_put_b(uint8_t b)
         move_cursor_start();
     } else if (b == FB_BACKSPACE_ASCII) {
         move_cursor_back();
-        uint8_t *cell = fb + 2 * cursor_pos;
-        write_cell(cell, ' ');
+        write_at_cursor(' ');
     } else if (b == '\t') {
         int i;
         for (i = 0; i < 4; ++i) {
-            fb_put_b(' ');
+            put_b(' ');
         }
     } else {
         move_cursor_forward();
     }
 
-    if (cursor_pos >= FB_NUM_COLS * FB_NUM_ROWS) {
-        scroll();
-        fb_move_cursor(24, 0);
-    }
+    scroll_if_needed();
+}
+
+void fb_put_b(uint8_t b)
+{
+    uint32_t flags = spin_lock_irqsave(&fb_lock);
+    put_b(b);
+    set_cursor(cursor_pos);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 void fb_put_s(char const *s)
 {
+    uint32_t flags = spin_lock_irqsave(&fb_lock);
     while (*s != '\0') {
-        fb_put_b(*s++);
+        put_b(*s++);
     }
+    set_cursor(cursor_pos);
+    spin_unlock_irqrestore(&fb_lock, flags);
+}
+
+static void write_buf(char const *buf, size_t len)
+{
+    uint32_t i = 0, n, row, col;
+    uint16_t *cells;
+
+    while (i < len) {
+        row = cursor_pos / FB_NUM_COLS;
+        col = cursor_pos % FB_NUM_COLS;
+        cells = shadow_row(row);
+
+        /* copy the plain characters up to the end of the row in one go */
+        n = 0;
+        while (i + n < len && col + n < FB_NUM_COLS &&
+               !is_special(buf[i + n])) {
+            cells[col + n] = FB_CELL((uint8_t) buf[i + n]);
+            ++n;
+        }
+
+        if (n > 0) {
+            dirty_rows |= 1 << row;
+            cursor_pos += n;
+            i += n;
+            scroll_if_needed();
+        } else {
+            put_b(buf[i++]);
+        }
+    }
+}
+
+/* buf might be a process' memory, so it is copied to the stack before the
+ * lock is taken and the lock is only held for one chunk at a time
+ */
+int fb_write_buf(char const *buf, size_t len)
+{
+    char chunk[FB_WRITE_CHUNK];
+    uint32_t i, n, flags;
+
+    for (i = 0; i < len; i += n) {
+        n = len - i < FB_WRITE_CHUNK ? len - i : FB_WRITE_CHUNK;
+        memcpy(chunk, buf + i, n);
+
+        flags = spin_lock_irqsave(&fb_lock);
+        write_buf(chunk, n);
+        spin_unlock_irqrestore(&fb_lock, flags);
+    }
+
+    flags = spin_lock_irqsave(&fb_lock);
+    set_cursor(cursor_pos);
+    flush();
+    spin_unlock_irqrestore(&fb_lock, flags);
+
+    return len;
 }
 
 void fb_put_ui(uint32_t i)
@@ -164,20 +315,22 @@ void fb_put_ui_hex(unsigned int n)
 
 void fb_clear()
 {
-    uint8_t i, j;
-    for (i = 0; i < FB_NUM_ROWS; ++i) {
-        for (j = 0; j < FB_NUM_COLS; ++j) {
-            write_at(' ', i, j);
-        }
+    uint32_t r, flags = spin_lock_irqsave(&fb_lock);
+    for (r = 0; r < FB_NUM_ROWS; ++r) {
+        clear_row(r);
     }
-    fb_move_cursor(0, 0);
+    flush();
+    cursor_pos = 0;
+    set_cursor(cursor_pos);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 void fb_move_cursor(uint16_t row, uint16_t col)
 {
-    uint16_t loc = row*FB_NUM_COLS + col;
-    cursor_pos = loc;
-    set_cursor(loc);
+    uint32_t flags = spin_lock_irqsave(&fb_lock);
+    cursor_pos = row*FB_NUM_COLS + col;
+    set_cursor(cursor_pos);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 static int fb_open(vnode_t *n)
@@ -196,11 +349,12 @@ static int fb_lookup(vnode_t *n, char const *p, vnode_t *o)
 	return -1;
 }
 
-static int fb_read(vnode_t *n, void *buf, uint32_t count)
+static int fb_read(vnode_t *n, void *buf, uint32_t count, uint32_t offset)
 {
 	UNUSED_ARGUMENT(n);
 	UNUSED_ARGUMENT(buf);
 	UNUSED_ARGUMENT(count);
+	UNUSED_ARGUMENT(offset);
 
 	/* TODO: this can actually be implemented by copying the console memory */
 
@@ -218,11 +372,8 @@ static int fb_getattr(vnode_t *n, vattr_t *attr)
 static int fb_write(vnode_t *n, char const *str, size_t len)
 {
 	UNUSED_ARGUMENT(n);
-	UNUSED_ARGUMENT(len);
 
-	fb_put_s(str);
-
-	return 0;
+	return fb_write_buf(str, len);
 }
 
 int fb_init(void)
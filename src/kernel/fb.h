@@ -4,14 +4,24 @@
 #include "stdint.h"
 #include "vnode.h"
 
+/* The fb_put functions write to a shadow buffer, fb_flush shows the output */
 void fb_put_b(uint8_t b);
 void fb_put_s(char const *s);
 
+/* Writes len bytes of buf and flushes them to the screen.
+ *
+ * @return The number of bytes written
+ */
+int fb_write_buf(char const *buf, size_t len);
+
 /* output unsigned integer in decimal format */
 void fb_put_ui(uint32_t i);
 /* output unsigned integer in hexadecimal format */
 void fb_put_ui_hex(uint32_t i);
 
+/* copies the changed rows of the shadow buffer to the screen */
+void fb_flush(void);
+
 void fb_clear();
 void fb_move_cursor(uint16_t row, uint16_t col);
 
@@ -0,0 +1,191 @@
+#include "fpu.h"
+#include "interrupt.h"
+#include "scheduler.h"
+#include "common.h"
+#include "string.h"
+#include "log.h"
+#include "smp.h"
+
+#define FPU_NM_INT_IDX      7 /* device-not-available */
+#define FPU_XM_INT_IDX      19 /* SIMD floating-point exception */
+
+#define CPUID_FEATURE_FPU   (1 << 0)
+#define CPUID_FEATURE_FXSR  (1 << 24)
+#define CPUID_FEATURE_SSE   (1 << 25)
+
+/* defined in fpu_asm.s */
+uint32_t fpu_cpuid_features(void);
+void fpu_enable(void);
+void fpu_set_ts(void);
+void fpu_clear_ts(void);
+void fpu_save(uint8_t *area);
+void fpu_restore(uint8_t *area);
+
+/* the state currently loaded in each CPU's FPU registers, NULL = none */
+static fpu_state_t *fpu_owner[SMP_MAX_CPUS];
+static uint32_t fpu_enabled = 0;
+/* the state a process starts with when it first uses the FPU */
+static fpu_state_t initial_state;
+
+static uint8_t *fpu_area(fpu_state_t *state)
+{
+    return (uint8_t *) (((uint32_t) state->buf + 15) & ~0xF);
+}
+
+static void fpu_handle_nm_interrupt(cpu_state_t state, idt_info_t info,
+                                    stack_state_t stack)
+{
+    UNUSED_ARGUMENT(state);
+    UNUSED_ARGUMENT(info);
+    UNUSED_ARGUMENT(stack);
+    uint32_t cpu;
+
+    /* the PIT must not preempt us while the registers are half switched,
+     * or move us to another CPU */
+    disable_interrupts();
+    cpu = smp_cpu_id();
+    fpu_clear_ts();
+
+    ps_t *ps = scheduler_get_current_process();
+    if (ps == NULL) {
+        log_error("fpu_handle_nm_interrupt",
+                  "FPU used without a current process\n");
+        return;
+    }
+
+    if (fpu_owner[cpu] == &ps->fpu) {
+        return;
+    }
+
+    if (fpu_owner[cpu] != NULL) {
+        fpu_save(fpu_area(fpu_owner[cpu]));
+    }
+
+    if (ps->fpu.used) {
+        fpu_restore(fpu_area(&ps->fpu));
+    } else {
+        fpu_restore(fpu_area(&initial_state));
+        ps->fpu.used = 1;
+    }
+
+    fpu_owner[cpu] = &ps->fpu;
+}
+
+/* Only raised if the process has unmasked the exception in MXCSR. There are
+ * no signals to deliver it with, and returning would only run the faulting
+ * instruction again, so the process is terminated.
+ */
+static void fpu_handle_xm_interrupt(cpu_state_t state, idt_info_t info,
+                                    stack_state_t stack)
+{
+    UNUSED_ARGUMENT(state);
+    UNUSED_ARGUMENT(info);
+
+    ps_t *ps = scheduler_get_current_process();
+    if (ps == NULL) {
+        log_error("fpu_handle_xm_interrupt",
+                  "SIMD exception without a current process, eip: %X\n",
+                  stack.eip);
+        return;
+    }
+
+    log_error("fpu_handle_xm_interrupt",
+              "Unmasked SIMD exception in process %u, eip: %X, "
+              "terminating it\n", ps->id, stack.eip);
+    scheduler_exit();
+}
+
+int fpu_init(void)
+{
+    uint32_t required = CPUID_FEATURE_FPU | CPUID_FEATURE_FXSR |
+                        CPUID_FEATURE_SSE;
+    if ((fpu_cpuid_features() & required) != required) {
+        log_error("fpu_init", "The CPU lacks FXSAVE or SSE support\n");
+        return -1;
+    }
+
+    /* the FPU is left disabled if the traps can't be handled */
+    if (register_interrupt_handler(FPU_NM_INT_IDX, fpu_handle_nm_interrupt)) {
+        log_error("fpu_init", "Couldn't register the #NM handler\n");
+        return -1;
+    }
+    if (register_interrupt_handler(FPU_XM_INT_IDX, fpu_handle_xm_interrupt)) {
+        log_error("fpu_init", "Couldn't register the #XM handler\n");
+        return -1;
+    }
+
+    fpu_enable();
+    fpu_save(fpu_area(&initial_state));
+
+    /* nobody owns the FPU yet, the first use must trap */
+    fpu_set_ts();
+    fpu_enabled = 1;
+
+    return 0;
+}
+
+void fpu_init_cpu(void)
+{
+    if (fpu_enabled) {
+        fpu_enable();
+        fpu_set_ts();
+    }
+}
+
+void fpu_state_init(fpu_state_t *state)
+{
+    state->used = 0;
+}
+
+void fpu_switch(fpu_state_t *state)
+{
+    /* without fpu_init the #NM trap must never be armed */
+    if (!fpu_enabled) {
+        return;
+    }
+
+    if (state == fpu_owner[smp_cpu_id()]) {
+        fpu_clear_ts();
+    } else {
+        fpu_set_ts();
+    }
+}
+
+void fpu_release(fpu_state_t *state)
+{
+    uint32_t cpu;
+    for (cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        if (state == fpu_owner[cpu]) {
+            fpu_owner[cpu] = NULL;
+        }
+    }
+}
+
+int fpu_is_loaded_elsewhere(fpu_state_t *state)
+{
+    uint32_t cpu, self = smp_cpu_id();
+    for (cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        if (cpu != self && state == fpu_owner[cpu]) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void fpu_copy(fpu_state_t *dst, fpu_state_t *src)
+{
+    if (!fpu_enabled) {
+        dst->used = 0;
+        return;
+    }
+
+    if (src == fpu_owner[smp_cpu_id()]) {
+        /* the registers are newer than the saved area */
+        fpu_clear_ts();
+        fpu_save(fpu_area(src));
+    }
+
+    memcpy(fpu_area(dst), fpu_area(src), FPU_STATE_SIZE);
+    dst->used = src->used;
+}
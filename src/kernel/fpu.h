@@ -0,0 +1,40 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "stdint.h"
+
+#define FPU_STATE_SIZE 512 /* the size of an FXSAVE area */
+
+/* The x87/SSE registers of a process. The state is only saved and restored
+ * when another process uses the FPU (lazy switching through CR0.TS), so
+ * processes that never touch the FPU don't pay anything for it.
+ */
+struct fpu_state {
+    /* FXSAVE needs a 16 byte aligned area, use fpu_area to get it */
+    uint8_t buf[FPU_STATE_SIZE + 15];
+    uint32_t used; /* non-zero once the process has used the FPU */
+};
+typedef struct fpu_state fpu_state_t;
+
+int fpu_init(void);
+/* enables the FPU on an application processor, after fpu_init */
+void fpu_init_cpu(void);
+void fpu_state_init(fpu_state_t *state);
+
+/* Called by the scheduler when the process with the given state is given
+ * the CPU, arms the device-not-available trap unless it owns the FPU.
+ */
+void fpu_switch(fpu_state_t *state);
+
+/* Called when the state will be freed or doesn't matter anymore */
+void fpu_release(fpu_state_t *state);
+
+/* Returns non-zero if the state is only up to date in the registers of
+ * another CPU, the process can't be migrated to this CPU then.
+ */
+int fpu_is_loaded_elsewhere(fpu_state_t *state);
+
+/* Gives dst a copy of src, e.g. when forking */
+void fpu_copy(fpu_state_t *dst, fpu_state_t *src);
+
+#endif /* FPU_H */
@@ -0,0 +1,53 @@
+global fpu_cpuid_features
+global fpu_enable
+global fpu_set_ts
+global fpu_clear_ts
+global fpu_save
+global fpu_restore
+
+CR0_MP      equ 1 << 1      ; WAIT/FWAIT honours the TS flag
+CR0_EM      equ 1 << 2      ; x87 emulation, must be off for SSE
+CR0_TS      equ 1 << 3      ; task switched, FPU instructions trap to #NM
+CR0_NE      equ 1 << 5      ; report FPU errors with exceptions, not IRQ13
+CR4_OSFXSR  equ 1 << 9      ; OS supports FXSAVE/FXRSTOR and SSE
+CR4_OSXMMEXCPT equ 1 << 10  ; OS handles unmasked SIMD exceptions
+
+section .text
+fpu_cpuid_features:
+    push ebx            ; cpuid clobbers ebx, which is callee saved
+    mov eax, 1          ; leaf 1: processor info and feature bits
+    cpuid
+    mov eax, edx        ; return the feature flags in edx
+    pop ebx
+    ret
+
+fpu_enable:
+    mov eax, cr0
+    and eax, ~(CR0_EM | CR0_TS)
+    or  eax, CR0_MP | CR0_NE
+    mov cr0, eax
+    mov eax, cr4
+    or  eax, CR4_OSFXSR | CR4_OSXMMEXCPT
+    mov cr4, eax
+    fninit              ; starts with a clean x87 state
+    ret
+
+fpu_set_ts:
+    mov eax, cr0
+    or  eax, CR0_TS
+    mov cr0, eax
+    ret
+
+fpu_clear_ts:
+    clts
+    ret
+
+fpu_save:
+    mov eax, [esp+4]    ; the 16 byte aligned area to save to
+    fxsave [eax]
+    ret
+
+fpu_restore:
+    mov eax, [esp+4]    ; the 16 byte aligned area to restore from
+    fxrstor [eax]
+    ret
@@ -7,9 +7,10 @@
 #define CODE_RX_TYPE    0xA
 #define DATA_RW_TYPE    0x2
 
-#define GDT_NUM_ENTRIES 6
+#define GDT_TSS_START   5 /* one TSS entry per CPU follows the segments */
+#define GDT_NUM_ENTRIES (GDT_TSS_START + SMP_MAX_CPUS)
 
-#define TSS_SEGSEL      (5*8)
+#define TSS_SEGSEL(cpu) ((GDT_TSS_START + (cpu))*8)
 
 struct gdt_entry {
     uint16_t limit_low;     /* The lower 16 bits of the limit */
@@ -34,11 +35,9 @@ void gdt_load_and_set(uint32_t);
 static void gdt_create_entry(uint32_t n, uint8_t pl, uint8_t type);
 static void gdt_create_tss_entry(uint32_t n, uint32_t tss_vaddr);
 
-void gdt_init(uint32_t tss_vaddr)
+void gdt_init(void)
 {
-	gdt_ptr_t gdt_ptr;
-    gdt_ptr.limit   = sizeof(gdt_entry_t)*GDT_NUM_ENTRIES;
-    gdt_ptr.base    = (uint32_t)&gdt_entries;
+    uint32_t cpu;
 
     /* the null entry */
     gdt_create_entry(0, 0, 0);
@@ -51,11 +50,23 @@ void gdt_init(uint32_t tss_vaddr)
     /* user mode data segment */
     gdt_create_entry(4, PL3, DATA_RW_TYPE);
 
-    gdt_create_tss_entry(5, tss_vaddr);
+    for (cpu = 0; cpu < SMP_MAX_CPUS; ++cpu) {
+        gdt_create_tss_entry(GDT_TSS_START + cpu, tss_vaddr(cpu));
+    }
+
+    gdt_load_cpu(0);
+}
+
+void gdt_load_cpu(uint32_t cpu)
+{
+	gdt_ptr_t gdt_ptr;
+    gdt_ptr.limit   = sizeof(gdt_entry_t)*GDT_NUM_ENTRIES;
+    gdt_ptr.base    = (uint32_t)&gdt_entries;
 
     gdt_load_and_set((uint32_t)&gdt_ptr);
 
-    tss_load_and_set(TSS_SEGSEL);
+    /* every CPU needs its own TSS, since ltr marks the TSS as busy */
+    tss_load_and_set(TSS_SEGSEL(cpu));
 }
 
 
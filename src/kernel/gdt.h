@@ -7,7 +7,9 @@
 #define PL0 0x0
 #define PL3 0x3
 
-void gdt_init(uint32_t tss_vaddr);
+void gdt_init(void);
+/* Loads the GDT and the TSS of the given CPU on the calling CPU */
+void gdt_load_cpu(uint32_t cpu);
 
 #endif /* GDT_H */
 
@@ -57,6 +57,11 @@ DECLARE_INTERRUPT_HANDLER(45);
 DECLARE_INTERRUPT_HANDLER(46);
 DECLARE_INTERRUPT_HANDLER(47);
 
+/* local APIC interrupts, see apic.h */
+DECLARE_INTERRUPT_HANDLER(48);
+DECLARE_INTERRUPT_HANDLER(49);
+DECLARE_INTERRUPT_HANDLER(255);
+
 struct idt_gate {
 	uint16_t handler_low;
 	uint16_t segsel;
@@ -85,10 +90,6 @@ static void create_idt_gate(uint8_t n, uint32_t handler, uint8_t type,
 
 void idt_init(void)
 {
-    idt_ptr_t idt_ptr;
-    idt_ptr.limit = IDT_NUM_ENTRIES * sizeof(idt_gate_t) - 1;
-    idt_ptr.base  = (uint32_t) &idt;
-
     /* Protected mode exceptions */
     CREATE_IDT_GATE(0);
     CREATE_IDT_GATE(1);
@@ -129,10 +130,24 @@ void idt_init(void)
     CREATE_IDT_GATE(46);
     CREATE_IDT_GATE(47);
 
+    /* local APIC interrupts */
+    CREATE_IDT_GATE(48);
+    CREATE_IDT_GATE(49);
+    CREATE_IDT_GATE(255);
+
     /* System call interrupt */
     create_idt_gate(SYSCALL_INT_IDX, (uint32_t) handle_syscall,
                     IDT_TRAP_GATE_TYPE, PL3);
 
+    idt_load();
+}
+
+void idt_load(void)
+{
+    idt_ptr_t idt_ptr;
+    idt_ptr.limit = IDT_NUM_ENTRIES * sizeof(idt_gate_t) - 1;
+    idt_ptr.base  = (uint32_t) &idt;
+
     idt_load_and_set((uint32_t) &idt_ptr);
 }
 
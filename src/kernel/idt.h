@@ -4,5 +4,7 @@
 #define IDT_NUM_ENTRIES 256
 
 void idt_init(void);
+/* Loads the IDT created by idt_init on the calling CPU */
+void idt_load(void);
 
 #endif /* IDT_H */
@@ -7,6 +7,8 @@
 #include "stdio.h"
 #include "log.h"
 #include "constants.h"
+#include "softirq.h"
+#include "scheduler.h"
 
 static interrupt_handler_t interrupt_handlers[IDT_NUM_ENTRIES];
 
@@ -36,4 +38,11 @@ void interrupt_handler(cpu_state_t state, idt_info_t info, stack_state_t exec)
                   "unhandled interrupt: %u, eip: %X, cs: %X, eflags: %X\n",
                   info.idt_index, exec.eip, exec.cs, exec.eflags);
     }
+
+    /* the bottom halves and the process switch are left to the outermost
+     * handler, a nested one returns to the softirq it interrupted */
+    disable_interrupts();
+    if (softirq_run()) {
+        scheduler_handle_need_resched(&state, &exec);
+    }
 }
@@ -40,6 +40,9 @@ uint32_t register_interrupt_handler(uint32_t interrupt,
 
 void enable_interrupts(void);
 void disable_interrupts(void);
+/* returns EFLAGS, to be given to interrupts_restore */
+uint32_t interrupts_save_and_disable(void);
+void interrupts_restore(uint32_t flags);
 void switch_to_kernel_stack(void (*continuation)(uint32_t), uint32_t data);
 
 #endif /* INTERRUPT_H */
@@ -2,12 +2,15 @@
 
 extern interrupt_handler
 extern syscall_handle_interrupt
-extern kernel_stack
+extern smp_kernel_stack_top
 extern run_process_in_user_mode
 
 global enable_interrupts
 global disable_interrupts
+global interrupts_save_and_disable
+global interrupts_restore
 global handle_syscall
+global handle_sysenter
 global switch_to_kernel_stack
 
 %macro no_error_code_handler 1
@@ -58,6 +61,17 @@ disable_interrupts:
     cli
     ret
 
+interrupts_save_and_disable:
+    pushf                   ; the old EFLAGS are the return value
+    pop     eax
+    cli
+    ret
+
+interrupts_restore:
+    push    DWORD [esp+4]   ; only IF can differ, so restore all of EFLAGS
+    popf
+    ret
+
 ; protected mode exceptions
 no_error_code_handler 0
 no_error_code_handler 1
@@ -98,14 +112,20 @@ no_error_code_handler 45
 no_error_code_handler 46
 no_error_code_handler 47
 
+; local apic interrupts
+no_error_code_handler 48
+no_error_code_handler 49
+no_error_code_handler 255
+
 ; system call interrupt
 handle_syscall:
-    ;cli             ; TODO: replace with kernel locks
+    ; interrupts stay enabled, shared data is protected by spinlocks
+    ; push in the reverse order of cpu_state_t
+    push	esp
     push	eax
+    push	ebx
     push	ecx
     push	edx
-    push	ebx
-    push	esp
     push	ebp
     push	esi
     push	edi
@@ -114,11 +134,62 @@ handle_syscall:
     call    run_process_in_user_mode
     jmp     $
 
+; fast system call entry, see sysenter.h
+; - the CPU has loaded esp from MSR_SYSENTER_ESP and cleared IF, ecx holds
+;   the user esp and edx the user eip. The stack is set up the same way as
+;   the CPU does it for int 0xAE, so the rest is shared with handle_syscall.
+;   The second and third argument come in esi and edi, they are moved to the
+;   ecx and edx slots where syscall_handle_interrupt expects them.
+handle_sysenter:
+    push    DWORD (SEGSEL_USER_SPACE_DS | 0x03)     ; user ss
+    push    ecx                                     ; user esp
+    pushf
+    or      DWORD [esp], 0x200      ; the user had interrupts enabled
+    push    DWORD (SEGSEL_USER_SPACE_CS | 0x03)     ; user cs
+    push    edx                                     ; user eip
+    push	esp
+    push	eax
+    push	ebx
+    push	esi                 ; second argument, as ecx
+    push	edi                 ; third argument, as edx
+    push	ebp
+    push	esi
+    push	edi
+    sti
+    call	syscall_handle_interrupt
+    push    eax
+    call    return_with_sysexit
+    jmp     $
+
+; return_with_sysexit - returns to user mode with the given registers_t, ecx
+; and edx are clobbered since sysexit uses them for esp and eip
+return_with_sysexit:
+    cli
+    mov     eax, [esp+4]            ; load address of registers_t into eax
+
+    mov     ebx, [eax+4]
+    mov     ebp, [eax+16]
+    mov     esi, [eax+20]
+    mov     edi, [eax+24]
+    mov     ecx, [eax+32]           ; the ESP of the user stack
+    mov     edx, [eax+44]           ; the EIP to return to
+
+    push    DWORD [eax+36]          ; restore EFLAGS, except IF
+    and     DWORD [esp], ~0x200
+    popf
+
+    mov     eax, [eax]              ; restore eax
+
+    sti                             ; takes effect after the sysexit
+    sysexit
+
 switch_to_kernel_stack:
     cli                     ; can't be interrupted while running on shared stack
+    call    smp_kernel_stack_top ; every cpu has its own stack, top in eax
+    mov     ecx, eax
     mov     eax, [esp+4]	; load address of continuation into eax
     mov     ebx, [esp+8]    ; load the data into ebx
-    mov	    esp, kernel_stack + KERNEL_STACK_SIZE
+    mov	    esp, ecx
     push    ebx             ; push the data on the new stack
     call    eax             ; use call instead of jmp since C expects ret addr
     jmp     $
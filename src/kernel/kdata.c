@@ -0,0 +1,99 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_MM
+
+#include "kdata.h"
+#include "page_frame_allocator.h"
+#include "string.h"
+#include "constants.h"
+#include "stddef.h"
+#include "log.h"
+
+static kdata_t *kdata = NULL;
+static uint32_t kdata_paddr = 0;
+
+/* Allocates a page frame and maps it in the kernel.
+ *
+ * @return The virtual address of the zeroed page, or 0 on failure
+ */
+static uint32_t kdata_allocate_page(uint32_t *out_paddr)
+{
+    uint32_t vaddr, paddr;
+
+    paddr = pfa_allocate(1);
+    if (paddr == 0) {
+        log_error("kdata_allocate_page", "Couldn't allocate a page frame\n");
+        return 0;
+    }
+
+    vaddr = pdt_kernel_map_next(paddr, FOUR_KB,
+                                PAGING_READ_WRITE, PAGING_PL0);
+    if (vaddr == 0) {
+        log_error("kdata_allocate_page", "Couldn't map the page in the "
+                  "kernel. paddr: %X\n", paddr);
+        pfa_free(paddr);
+        return 0;
+    }
+
+    memset((void *) vaddr, 0, FOUR_KB);
+    *out_paddr = paddr;
+    return vaddr;
+}
+
+int kdata_init(void)
+{
+    uint32_t vaddr = kdata_allocate_page(&kdata_paddr);
+    if (vaddr == 0) {
+        log_error("kdata_init", "Couldn't create the global page\n");
+        return -1;
+    }
+
+    kdata = (kdata_t *) vaddr;
+    return 0;
+}
+
+void kdata_set_uptime(uint32_t uptime)
+{
+    if (kdata != NULL) {
+        kdata->uptime = uptime;
+    }
+}
+
+kdata_ps_t *kdata_ps_create(pde_t *pdt, uint32_t *out_paddr)
+{
+    uint32_t vaddr, paddr, size;
+
+    if (kdata == NULL) {
+        log_error("kdata_ps_create", "kdata_init hasn't been called\n");
+        return NULL;
+    }
+
+    size = pdt_map_memory(pdt, kdata_paddr, KDATA_VADDR, FOUR_KB,
+                          PAGING_READ_ONLY, PAGING_PL3);
+    if (size < FOUR_KB) {
+        log_error("kdata_ps_create", "Couldn't map the global page in the "
+                  "process. pdt: %X\n", (uint32_t) pdt);
+        return NULL;
+    }
+
+    vaddr = kdata_allocate_page(&paddr);
+    if (vaddr == 0) {
+        return NULL;
+    }
+
+    size = pdt_map_memory(pdt, paddr, KDATA_PS_VADDR, FOUR_KB,
+                          PAGING_READ_ONLY, PAGING_PL3);
+    if (size < FOUR_KB) {
+        log_error("kdata_ps_create", "Couldn't map the process page in the "
+                  "process. paddr: %X\n", paddr);
+        kdata_ps_delete((kdata_ps_t *) vaddr, paddr);
+        return NULL;
+    }
+
+    *out_paddr = paddr;
+    return (kdata_ps_t *) vaddr;
+}
+
+void kdata_ps_delete(kdata_ps_t *page, uint32_t paddr)
+{
+    pdt_unmap_kernel_memory((uint32_t) page, FOUR_KB);
+    pfa_free(paddr);
+}
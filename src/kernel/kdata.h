@@ -0,0 +1,42 @@
+#ifndef KDATA_H
+#define KDATA_H
+
+#include "stdint.h"
+#include "paging.h"
+
+/* Kernel data that processes can read without a syscall. Every process gets
+ * two read-only pages: one shared by all processes that holds the global
+ * data, and one of its own that holds its identity. The kernel writes to
+ * them through its own mappings.
+ */
+
+#define KDATA_VADDR     0x3FFFE000  /* the global page */
+#define KDATA_PS_VADDR  0x3FFFF000  /* the process' page */
+
+/* must be kept in sync with libc/sys/kdata.h */
+struct kdata {
+    volatile uint32_t uptime;       /* time since the scheduler started, ms */
+} __attribute__((packed));
+typedef struct kdata kdata_t;
+
+struct kdata_ps {
+    volatile uint32_t pid;
+    volatile uint32_t ppid;
+} __attribute__((packed));
+typedef struct kdata_ps kdata_ps_t;
+
+int kdata_init(void);
+void kdata_set_uptime(uint32_t uptime);
+
+/* Maps the global page and a new process page in pdt.
+ *
+ * @param out_paddr The physical address of the process page, needed by
+ *                  kdata_ps_delete
+ * @return The kernel's mapping of the process page, or NULL on failure
+ */
+kdata_ps_t *kdata_ps_create(pde_t *pdt, uint32_t *out_paddr);
+/* frees the process page, the mappings in the process PDT are left to
+ * pdt_delete */
+void kdata_ps_delete(kdata_ps_t *page, uint32_t paddr);
+
+#endif /* KDATA_H */
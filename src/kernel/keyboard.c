@@ -3,6 +3,8 @@
 #include "interrupt.h"
 #include "common.h"
 #include "pic.h"
+#include "softirq.h"
+#include "tty.h"
 
 #define KBD_DATA_PORT   0x60
 #define KBD_BUFFER_SIZE 512
@@ -71,131 +73,62 @@ static uint8_t is_lshift_down       = 0;
 static uint8_t is_rshift_down       = 0;
 static uint8_t is_caps_lock_pressed = 0;
 
+/* the scan codes are queued by the interrupt handler and translated by the
+ * tasklet, the indices are free running */
 struct kbd_buffer {
     uint8_t buffer[KBD_BUFFER_SIZE];
-    uint8_t *head;
-    uint8_t *tail;
-    uint32_t count;
+    volatile uint32_t head;     /* only changed by the tasklet */
+    volatile uint32_t tail;     /* only changed by the interrupt handler */
 };
 typedef struct kbd_buffer kbd_buffer_t;
 static kbd_buffer_t kbd_buffer;
 
-static vnode_t kbd_vnode;
-static vnodeops_t kbd_vnodeops;
-
 /* function declarations */
 static char kbd_scan_code_to_ascii(uint8_t sc);
 static uint8_t kbd_read_scan_code(void);
 
-static void keyboard_handle_interrupt(cpu_state_t state,
-                                      idt_info_t info,
-                                      stack_state_t exec)
+/* hands the typed characters to the console tty */
+static void keyboard_tasklet(uint32_t data)
 {
-    UNUSED_ARGUMENT(state);
-    UNUSED_ARGUMENT(info);
-    UNUSED_ARGUMENT(exec);
-
-    /* DO NOT MODIFY kbd_buffer.head in this function,
-     * it will introcude race conditions!
-     */
+    UNUSED_ARGUMENT(data);
 
-    if (kbd_buffer.count < KBD_BUFFER_SIZE) {
-        *kbd_buffer.tail++ = kbd_read_scan_code();
-        ++kbd_buffer.count;
-        if (kbd_buffer.tail == kbd_buffer.buffer + KBD_BUFFER_SIZE) {
-            kbd_buffer.tail = kbd_buffer.buffer;
+    char ch;
+    while (kbd_buffer.head != kbd_buffer.tail) {
+        ch = kbd_scan_code_to_ascii(
+            kbd_buffer.buffer[kbd_buffer.head % KBD_BUFFER_SIZE]);
+        kbd_buffer.head++;
+        if (ch != -1) {
+            tty_console_input(ch);
         }
     }
-
-    pic_acknowledge();
 }
 
-static int kbd_open(vnode_t *n)
-{
-    UNUSED_ARGUMENT(n);
-
-    return 0;
-}
-
-static int kbd_lookup(vnode_t *d, char const *n, vnode_t *o)
-{
-    UNUSED_ARGUMENT(d);
-    UNUSED_ARGUMENT(n);
-    UNUSED_ARGUMENT(o);
+static tasklet_t kbd_tasklet = TASKLET_INIT(&keyboard_tasklet, 0);
 
-    return -1;
-}
-
-static int kbd_read(vnode_t *n, void *buf, size_t count)
+static void keyboard_handle_interrupt(cpu_state_t state,
+                                      idt_info_t info,
+                                      stack_state_t exec)
 {
-    UNUSED_ARGUMENT(n);
-
-    /* DO NOT MODIFY kbd_buffer.tail or kbd_buffer.count in this function,
-     * it will introcude race conditions!
-     */
+    UNUSED_ARGUMENT(state);
+    UNUSED_ARGUMENT(info);
+    UNUSED_ARGUMENT(exec);
 
-    char ch;
-    int i = 0;
-    char *b = buf;
-
-    while (count > 0) {
-        while (kbd_buffer.head != kbd_buffer.tail) {
-            ch = kbd_scan_code_to_ascii(*kbd_buffer.head++);
-            if (kbd_buffer.head == kbd_buffer.buffer + KBD_BUFFER_SIZE) {
-                kbd_buffer.head = kbd_buffer.buffer;
-            }
-            if (ch != -1) {
-                b[i] = ch;
-                ++i;
-                --count;
-            }
-        }
+    uint8_t sc = kbd_read_scan_code();
+    if (kbd_buffer.tail - kbd_buffer.head < KBD_BUFFER_SIZE) {
+        kbd_buffer.buffer[kbd_buffer.tail % KBD_BUFFER_SIZE] = sc;
+        kbd_buffer.tail++;
     }
+    tasklet_schedule(&kbd_tasklet);
 
-    return i;
-}
-
-static int kbd_write(vnode_t *n, char const *name, size_t count)
-{
-    UNUSED_ARGUMENT(n);
-    UNUSED_ARGUMENT(name);
-    UNUSED_ARGUMENT(count);
-
-    return -1;
-}
-
-static int kbd_getattr(vnode_t *n, vattr_t *a)
-{
-    UNUSED_ARGUMENT(n);
-    UNUSED_ARGUMENT(a);
-
-    return -1;
+    pic_acknowledge();
 }
 
 uint32_t kbd_init(void)
 {
     register_interrupt_handler(KBD_INT_IDX, keyboard_handle_interrupt);
 
-    kbd_buffer.count = 0;
-    kbd_buffer.head = kbd_buffer.buffer;
-    kbd_buffer.tail = kbd_buffer.buffer;
-
-    kbd_vnodeops.vn_open = &kbd_open;
-    kbd_vnodeops.vn_lookup = &kbd_lookup;
-    kbd_vnodeops.vn_read = &kbd_read;
-    kbd_vnodeops.vn_write = &kbd_write;
-    kbd_vnodeops.vn_getattr = &kbd_getattr;
-
-    kbd_vnode.v_op = &kbd_vnodeops;
-    kbd_vnode.v_data = 0;
-
-    return 0;
-}
-
-int kbd_get_vnode(vnode_t *out)
-{
-    out->v_op = kbd_vnode.v_op;
-    out->v_data = kbd_vnode.v_data;
+    kbd_buffer.head = 0;
+    kbd_buffer.tail = 0;
 
     return 0;
 }
@@ -2,9 +2,8 @@
 #define KEYBOARD_H
 
 #include "stdint.h"
-#include "vnode.h"
 
+/* the typed characters go to the console tty, see tty.h */
 uint32_t kbd_init(void);
-int kbd_get_vnode(vnode_t *out);
 
 #endif /* KEYBOARD_H */
@@ -24,6 +24,15 @@
 #include "kmalloc.h"
 #include "vfs.h"
 #include "devfs.h"
+#include "schedstat.h"
+#include "fpu.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "sysenter.h"
+#include "kdata.h"
+#include "kmsg.h"
+#include "tty.h"
 
 #define KINIT_ERROR_LOAD_FS 1
 #define KINIT_ERROR_INIT_FS 2
@@ -32,6 +41,7 @@
 #define KINIT_ERROR_MALLOC_ROOT_VFS 5
 #define KINIT_ERROR_INIT_VFS 6
 #define KINIT_ERROR_INIT_SCHEDULER 7
+#define KINIT_ERROR_INIT_KDATA 8
 
 /* Gets the physical address of the filesystem, which is the address of the
  * only GRUB module loaded
@@ -89,7 +99,12 @@ static uint32_t populate_devfs()
     devfs_init(devfs);
 
     add_device("console", fb_get_vnode);
-    add_device("keyboard", kbd_get_vnode);
+    add_device("tty", tty_console_get_vnode);
+    add_device("ttyS0", serial_ttyS0_get_vnode);
+    add_device("ttyS1", serial_ttyS1_get_vnode);
+    add_device("schedstat", schedstat_get_vnode);
+    add_device("lockstat", lockstat_get_vnode);
+    add_device("kmsg", kmsg_get_vnode);
 
     vfs_mount("/dev/", devfs);
 
@@ -103,23 +118,33 @@ static uint32_t kinit(kernel_meminfo_t *mem,
 {
     uint32_t fs_paddr, fs_size;
     uint32_t res;
-    uint32_t tss_vaddr;
     disable_interrupts();
 
     fb_init();
+    log_init(mbinfo->flags & MULTIBOOT_INFO_CMDLINE ?
+             (char const *) mbinfo->cmdline : NULL);
 
     fs_paddr = get_fs_paddr(mbinfo, &fs_size);
     if (fs_paddr == 0 && fs_size == 0) {
         return KINIT_ERROR_LOAD_FS;
     }
 
-    tss_vaddr = tss_init();
-    gdt_init(tss_vaddr);
+    gdt_init();
     idt_init();
     pic_init();
+    softirq_init();
+    kmsg_init();
 
+    tty_console_init();
     kbd_init();
     serial_init(COM1);
+    serial_init(COM2);
+    schedstat_init();
+    lockstat_init();
+    if (fpu_init()) {
+        log_error("kinit", "Couldn't enable the FPU, processes can't use it\n");
+    }
+    sysenter_init();
 
     pit_init();
 
@@ -133,6 +158,11 @@ static uint32_t kinit(kernel_meminfo_t *mem,
         return KINIT_ERROR_INIT_PFA;
     }
 
+    res = kdata_init();
+    if (res != 0) {
+        return KINIT_ERROR_INIT_KDATA;
+    }
+
     vfs_t *aefs_vfs = kmalloc(sizeof(vfs_t));
     if (aefs_vfs == NULL) {
         return KINIT_ERROR_MALLOC_ROOT_VFS;
@@ -155,6 +185,8 @@ static uint32_t kinit(kernel_meminfo_t *mem,
         return KINIT_ERROR_INIT_SCHEDULER;
     }
 
+    smp_init();
+
     enable_interrupts();
     return 0;
 }
@@ -165,17 +197,25 @@ static multiboot_info_t *remap_multiboot_info(uint32_t mbaddr)
 
     mbinfo->mmap_addr = PHYSICAL_TO_VIRTUAL(mbinfo->mmap_addr);
     mbinfo->mods_addr = PHYSICAL_TO_VIRTUAL(mbinfo->mods_addr);
+    if (mbinfo->flags & MULTIBOOT_INFO_CMDLINE) {
+        mbinfo->cmdline = PHYSICAL_TO_VIRTUAL(mbinfo->cmdline);
+    }
 
     return mbinfo;
 }
 
 static void start_init()
 {
-    ps_t *init = process_create("/bin/init", scheduler_next_pid());
+    uint32_t pid = scheduler_next_pid();
+    ps_t *init = process_create("/bin/init", pid);
     if (init == NULL) {
+        scheduler_release_pid(pid);
         printf("ERROR: Could not create init!\n");
     } else {
         scheduler_add_runnable_process(init);
+        if (kmsg_start_drainer()) {
+            printf("ERROR: Could not start the kernel log drainer!\n");
+        }
         scheduler_schedule();
     }
 }
@@ -218,6 +258,9 @@ int kmain(uint32_t mbaddr, uint32_t magic_number, kernel_meminfo_t mem,
             case KINIT_ERROR_INIT_SCHEDULER:
                 printf("ERROR: Could not initialize scheduler!\n");
                 break;
+            case KINIT_ERROR_INIT_KDATA:
+                printf("ERROR: Could not initialize the kdata page!\n");
+                break;
             default:
                 printf("ERROR: Unknown error\n");
                 break;
@@ -228,6 +271,9 @@ int kmain(uint32_t mbaddr, uint32_t magic_number, kernel_meminfo_t mem,
 
     log_info("kmain", "kernel initialized successfully!\n");
 
+    /* the APs are running, no tick may abandon this stack before init has
+     * been scheduled */
+    disable_interrupts();
     start_init();
 
     return 0xDEADBEEF;
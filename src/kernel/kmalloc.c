@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_MM
+
 #include "kmalloc.h"
 #include "stdio.h"
 #include "log.h"
@@ -5,6 +7,7 @@
 #include "paging.h"
 #include "page_frame_allocator.h"
 #include "constants.h"
+#include "spinlock.h"
 
 #define MIN_BLOCK_SIZE  1024 /* in units */
 
@@ -22,17 +25,22 @@ typedef struct header header_t;
 static header_t base;
 /* start of free list */
 static header_t *freep = 0;
+/* protects the free list */
+static spinlock_t kmalloc_lock = SPINLOCK_INIT("kmalloc");
 
 static void *acquire_more_heap(size_t nunits);
+static void free_block(void *ap);
 
 void *kmalloc(size_t nbytes)
 {
     header_t *p, *prevp;
     size_t nunits;
+    uint32_t flags;
 
     if (nbytes == 0)
         return NULL;
 
+    flags = spin_lock_irqsave(&kmalloc_lock);
     if (freep == 0) {
         /* no free list yet */
         base.next = freep = &base;
@@ -56,11 +64,13 @@ void *kmalloc(size_t nbytes)
                 p->size = nunits;
             }
             freep = prevp;
+            spin_unlock_irqrestore(&kmalloc_lock, flags);
             return (void *)(p+1);
         }
         if (p == freep) {
             /* wrapped around free list */
             if ((p = acquire_more_heap(nunits)) == NULL) {
+                spin_unlock_irqrestore(&kmalloc_lock, flags);
                 log_error("kmalloc", "Cannot acquire more memory. memory: %u",
                           nbytes);
                 return NULL;
@@ -71,7 +81,7 @@ void *kmalloc(size_t nbytes)
 
 static void *acquire_more_heap(size_t nunits)
 {
-    uint32_t vaddr, paddr, bytes, page_frames, mapped_mem;
+    uint32_t vaddr, paddr, bytes, page_frames;
     header_t *p;
 
     if (nunits < MIN_BLOCK_SIZE) {
@@ -90,40 +100,40 @@ static void *acquire_more_heap(size_t nunits)
         return NULL;
     }
 
-    vaddr = pdt_kernel_find_next_vaddr(bytes);
+    vaddr = pdt_kernel_map_next(paddr, bytes, PAGING_READ_WRITE, PAGING_PL0);
     if (vaddr == 0) {
         log_error("acquire_more_heap",
-                  "Could't find a virtual address. "
+                  "Could't map virtual memory. "
                   "paddr: %X, page_frames: %u, bytes: %u\n",
                   paddr, page_frames, bytes);
         return NULL;
     }
 
-    mapped_mem = pdt_map_kernel_memory(paddr, vaddr, bytes,
-                                       PAGING_READ_WRITE, PAGING_PL0);
-    if (mapped_mem < bytes) {
-        log_error("acquire_more_heap",
-                  "Could't map virtual memory. "
-                  "vaddr: %X, paddr: %X, page_frames: %u, bytes: %u\n",
-                  vaddr, paddr, page_frames, bytes);
-        return NULL;
-    }
-
     p = (header_t *) vaddr;
     p->size = bytes / sizeof(header_t);
 
-    kfree((void *)(p+1));
+    free_block((void *)(p+1));
 
     return freep;
 }
 
 void kfree(void * ap)
 {
-    header_t *bp, *p;
+    uint32_t flags;
 
     if (ap == 0)
         return;
 
+    flags = spin_lock_irqsave(&kmalloc_lock);
+    free_block(ap);
+    spin_unlock_irqrestore(&kmalloc_lock, flags);
+}
+
+/* kmalloc_lock must be held */
+static void free_block(void *ap)
+{
+    header_t *bp, *p;
+
     /* point to block header */
     bp = (header_t *)ap - 1;
     for (p = freep; !(bp > p && bp < p->next); p = p->next) {
@@ -0,0 +1,248 @@
+#include "kmsg.h"
+#include "serial.h"
+#include "softirq.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "stdio.h"
+#include "string.h"
+#include "common.h"
+#include "kthread.h"
+#include "log.h"
+
+#define KMSG_COM COM1
+/* room for the timestamp in front of the text */
+#define KMSG_LINE_SIZE (KMSG_TEXT_SIZE + 16)
+
+struct kmsg_record {
+    /* seq + 1 once the record is complete, 0 while it is being written */
+    volatile uint32_t committed;
+    uint32_t timestamp;         /* in ms */
+    uint32_t flags;
+    uint32_t len;
+    char text[KMSG_TEXT_SIZE];
+};
+typedef struct kmsg_record kmsg_record_t;
+
+static kmsg_record_t records[KMSG_NUM_RECORDS];
+/* the sequence number of the next record */
+static volatile uint32_t next_seq = 0;
+
+/* the next record to send to the serial port, only touched by the drainer */
+static uint32_t drain_seq = 0;
+/* the drainer thread sleeps here when it has nothing it can send */
+static wait_queue_t drainer_wait = WAIT_QUEUE_INIT;
+
+static vnodeops_t vnodeops;
+
+void kmsg_append(char const *text, uint32_t len, uint32_t flags)
+{
+    uint32_t seq = atomic_fetch_add(&next_seq, 1);
+    kmsg_record_t *rec = &records[seq % KMSG_NUM_RECORDS];
+
+    if (len > KMSG_TEXT_SIZE - 1) {
+        len = KMSG_TEXT_SIZE - 1;
+    }
+
+    rec->committed = 0;
+    rec->timestamp = scheduler_uptime();
+    rec->flags = flags;
+    rec->len = len;
+    memcpy(rec->text, text, len);
+    rec->text[len] = '\0';
+    /* a locked instruction, so the record is written before it's published */
+    atomic_xchg(&rec->committed, seq + 1);
+
+    softirq_raise(SOFTIRQ_KMSG);
+}
+
+/* Copies the record with sequence number *seq to out. Skips ahead to the
+ * oldest record if the reader has been lapped by the writers.
+ *
+ * @return 0 on success, -1 if the record hasn't been written yet
+ */
+static int kmsg_read_record(uint32_t *seq, kmsg_record_t *out)
+{
+    kmsg_record_t *rec;
+    uint32_t head;
+
+    while (1) {
+        head = next_seq;
+        if (*seq == head) {
+            return -1;
+        }
+
+        if (head - *seq > KMSG_NUM_RECORDS) {
+            *seq = head - KMSG_NUM_RECORDS;
+        }
+
+        rec = &records[*seq % KMSG_NUM_RECORDS];
+        if (rec->committed != *seq + 1) {
+            if (rec->committed == 0 || rec->committed < *seq + 1) {
+                /* still being written */
+                return -1;
+            }
+            /* overwritten, look for the oldest record again */
+            continue;
+        }
+
+        memcpy(out, rec, sizeof(kmsg_record_t));
+        if (rec->committed == *seq + 1) {
+            /* not overwritten while it was copied */
+            (*seq)++;
+            return 0;
+        }
+    }
+}
+
+static uint32_t kmsg_format(kmsg_record_t const *rec, char *buf, uint32_t size)
+{
+    if (rec->flags & KMSG_FLAG_CONT) {
+        return snprintf(buf, size, "%s", rec->text);
+    }
+    return snprintf(buf, size, "[%u] %s", rec->timestamp, rec->text);
+}
+
+static int kmsg_is_committed(uint32_t seq)
+{
+    return seq != next_seq &&
+           records[seq % KMSG_NUM_RECORDS].committed == seq + 1;
+}
+
+/* kmsg_append can be called with the scheduler's lock held, so it only
+ * raises the softirq, which wakes the drainer */
+static void kmsg_wake_drainer(void)
+{
+    scheduler_wake_all(&drainer_wait);
+}
+
+static void kmsg_drainer(void *arg)
+{
+    kmsg_record_t rec;
+    char line[KMSG_LINE_SIZE];
+    uint32_t len;
+    ps_t *ps = scheduler_get_current_process();
+
+    UNUSED_ARGUMENT(arg);
+
+    while (1) {
+        while (serial_tx_free(KMSG_COM) >= KMSG_LINE_SIZE) {
+            if (kmsg_read_record(&drain_seq, &rec)) {
+                break;
+            }
+            len = kmsg_format(&rec, line, KMSG_LINE_SIZE);
+            serial_write_buf(KMSG_COM, line, len);
+        }
+
+        /* blocked before the last check, so a record appended after it
+         * wakes the drainer again */
+        scheduler_prepare_wait(&drainer_wait);
+        if (kmsg_is_committed(drain_seq)) {
+            if (serial_tx_free(KMSG_COM) >= KMSG_LINE_SIZE) {
+                scheduler_wake_all(&drainer_wait);
+            } else {
+                /* try again on the next interrupt, once the UART has
+                 * caught up */
+                softirq_raise(SOFTIRQ_KMSG);
+            }
+        }
+        snapshot_and_schedule(&ps->current);
+    }
+}
+
+static int kmsg_open(vnode_t *n)
+{
+    UNUSED_ARGUMENT(n);
+
+    return 0;
+}
+
+static int kmsg_lookup(vnode_t *n, char const *p, vnode_t *o)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(p);
+    UNUSED_ARGUMENT(o);
+
+    return -1;
+}
+
+/* Every open file has its own position in the log, kept in v_data as the
+ * sequence number of the next record to read. Only whole records are
+ * returned, one per line:
+ *
+ *     [1234] INFO: kmain: kernel initialized successfully!
+ */
+static int kmsg_read(vnode_t *n, void *buf, size_t count, uint32_t offset)
+{
+    kmsg_record_t rec;
+    char line[KMSG_LINE_SIZE];
+    char *str = buf;
+    uint32_t seq = n->v_data, prev;
+    size_t len = 0, line_len;
+
+    /* the position is a record, not a byte offset */
+    UNUSED_ARGUMENT(offset);
+
+    while (1) {
+        prev = seq;
+        if (kmsg_read_record(&seq, &rec)) {
+            break;
+        }
+
+        line_len = kmsg_format(&rec, line, KMSG_LINE_SIZE);
+        if (line_len > count - len) {
+            /* read it again next time */
+            seq = prev;
+            break;
+        }
+
+        memcpy(str + len, line, line_len);
+        len += line_len;
+    }
+
+    n->v_data = seq;
+    return len;
+}
+
+static int kmsg_write(vnode_t *n, char const *buf, size_t count)
+{
+    UNUSED_ARGUMENT(n);
+
+    kmsg_append(buf, count, 0);
+    return count;
+}
+
+static int kmsg_getattr(vnode_t *n, vattr_t *attr)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(attr);
+
+    return -1;
+}
+
+void kmsg_init(void)
+{
+    vnodeops.vn_open = &kmsg_open;
+    vnodeops.vn_lookup = &kmsg_lookup;
+    vnodeops.vn_read = &kmsg_read;
+    vnodeops.vn_write = &kmsg_write;
+    vnodeops.vn_getattr = &kmsg_getattr;
+
+    softirq_register(SOFTIRQ_KMSG, &kmsg_wake_drainer);
+}
+
+int kmsg_start_drainer(void)
+{
+    if (kthread_create(&kmsg_drainer, NULL) == NULL) {
+        log_error("kmsg_start_drainer", "Could not create the drainer\n");
+        return -1;
+    }
+    return 0;
+}
+
+int kmsg_get_vnode(vnode_t *out)
+{
+    out->v_op = &vnodeops;
+    out->v_data = 0;
+
+    return 0;
+}
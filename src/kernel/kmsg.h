@@ -0,0 +1,31 @@
+#ifndef KMSG_H
+#define KMSG_H
+
+#include "stdint.h"
+#include "vnode.h"
+
+/* The kernel log, a fixed size ring of timestamped records in memory. Any
+ * CPU can append to it without taking a lock, even from an interrupt
+ * handler. The records are sent to the serial port by a kernel thread and
+ * can be read by user space from /dev/kmsg. When the ring is full the oldest
+ * records are overwritten.
+ */
+
+#define KMSG_NUM_RECORDS    512     /* must be a power of two */
+#define KMSG_TEXT_SIZE      116     /* including the terminating NUL */
+
+#define KMSG_FLAG_CONT      0x01    /* continues the previous record */
+
+/* Appends a record with the first len bytes of text, at most
+ * KMSG_TEXT_SIZE - 1 of them are kept.
+ */
+void kmsg_append(char const *text, uint32_t len, uint32_t flags);
+
+void kmsg_init(void);
+/* Starts the kernel thread that sends the records to the serial port, the
+ * records appended before are kept in the ring until then.
+ */
+int kmsg_start_drainer(void);
+int kmsg_get_vnode(vnode_t *out);
+
+#endif /* KMSG_H */
@@ -0,0 +1,46 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SCHED
+
+#include "kthread.h"
+#include "scheduler.h"
+#include "stddef.h"
+#include "log.h"
+
+static void kthread_start(kthread_fn_t fn, void *arg)
+{
+    fn(arg);
+    kthread_exit();
+}
+
+void kthread_exit(void)
+{
+    scheduler_exit();
+}
+
+ps_t *kthread_create(kthread_fn_t fn, void *arg)
+{
+    ps_t *ps;
+    uint32_t *stack;
+    uint32_t pid = scheduler_next_pid();
+    if (pid == 0) {
+        return NULL;
+    }
+
+    ps = process_create_kernel(pid);
+    if (ps == NULL) {
+        log_error("kthread_create", "Couldn't create kernel thread\n");
+        scheduler_release_pid(pid);
+        return NULL;
+    }
+
+    /* the thread starts as if kthread_start(fn, arg) had been called */
+    stack = (uint32_t *) (ps->current.esp - 8);
+    stack[0] = 0; /* return address, kthread_start never returns */
+    stack[1] = (uint32_t) fn;
+    stack[2] = (uint32_t) arg;
+    ps->current.esp = (uint32_t) stack;
+    ps->current.eip = (uint32_t) &kthread_start;
+
+    scheduler_add_runnable_process(ps);
+
+    return ps;
+}
@@ -0,0 +1,19 @@
+#ifndef KTHREAD_H
+#define KTHREAD_H
+
+#include "process.h"
+
+typedef void (*kthread_fn_t)(void *arg);
+
+/* Creates a kernel thread that runs fn(arg) in kernel mode on its own kernel
+ * stack, using the kernel PDT. The thread is scheduled like any other
+ * process and exits when fn returns.
+ *
+ * @return The ps_t of the thread, or NULL if it couldn't be created
+ */
+ps_t *kthread_create(kthread_fn_t fn, void *arg);
+
+/* Terminates the calling kernel thread, never returns */
+void kthread_exit(void);
+
+#endif /* KTHREAD_H */
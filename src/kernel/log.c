@@ -1,9 +1,35 @@
 #include "log.h"
-#include "serial.h"
+#include "kmsg.h"
+#include "string.h"
+#include "stddef.h"
 
-#define LOG_COM COM1
+#define LOG_LINE_SIZE (KMSG_TEXT_SIZE - 1)
 
-static void log_ui(uint32_t i)
+/* a message is formatted on the stack and appended to the kernel log as one
+ * record, longer messages are split into continuation records */
+struct log_line {
+    char buf[LOG_LINE_SIZE];
+    uint32_t len;
+    uint32_t flags;
+};
+typedef struct log_line log_line_t;
+
+static void log_flush(log_line_t *line)
+{
+    kmsg_append(line->buf, line->len, line->flags);
+    line->len = 0;
+    line->flags = KMSG_FLAG_CONT;
+}
+
+static void log_put(log_line_t *line, char c)
+{
+    if (line->len == LOG_LINE_SIZE) {
+        log_flush(line);
+    }
+    line->buf[line->len++] = c;
+}
+
+static void log_ui(log_line_t *line, uint32_t i)
 {
     /* FIXME: please make this code more beautiful */
     uint32_t n, digit;
@@ -17,13 +43,13 @@ static void log_ui(uint32_t i)
     }
     while (n > 0) {
         digit = i / n;
-        serial_write(LOG_COM, '0'+digit);
+        log_put(line, '0'+digit);
         i %= n;
         n /= 10;
     }
 }
 
-static void log_hex(uint32_t i)
+static void log_hex(log_line_t *line, uint32_t i)
 {
     char *digits = "0123456789ABCDEF";
     uint32_t n, digit, min_digits = 8;
@@ -38,8 +64,8 @@ static void log_hex(uint32_t i)
         }
     }
 
-    serial_write(LOG_COM, '0');
-    serial_write(LOG_COM, 'x');
+    log_put(line, '0');
+    log_put(line, 'x');
 
     /* pad with zeroes */
     if (min_digits > 0) {
@@ -47,13 +73,13 @@ static void log_hex(uint32_t i)
     }
     min_digits <<= 2;
     while (min_digits > n) {
-        serial_write(LOG_COM, '0');
+        log_put(line, '0');
         min_digits -= 4;
     }
     /* print the number */
     while (1) {
         digit = (i >> n) & 0x0000000F;
-        serial_write(LOG_COM, digits[digit]);
+        log_put(line, digits[digit]);
         if (n == 0) {
             break;
         }
@@ -61,7 +87,7 @@ static void log_hex(uint32_t i)
     }
 }
 
-static void log_vprintf(char *fmt, va_list ap)
+static void log_vprintf(log_line_t *line, char *fmt, va_list ap)
 {
     char *p;
     uint32_t uival;
@@ -69,68 +95,137 @@ static void log_vprintf(char *fmt, va_list ap)
 
     for (p = fmt; *p != '\0'; ++p) {
         if (*p != '%') {
-            serial_write(LOG_COM, *p);
+            log_put(line, *p);
             continue;
         }
 
         switch (*++p) {
             case 'c':
                 uival = va_arg(ap, uint32_t);
-                serial_write(LOG_COM, (uint8_t) uival);
+                log_put(line, (uint8_t) uival);
                 break;
             case 'u':
                 uival = va_arg(ap, uint32_t);
-                log_ui(uival);
+                log_ui(line, uival);
                 break;
             case 'X':
                 uival = va_arg(ap, uint32_t);
-                log_hex(uival);
+                log_hex(line, uival);
                 break;
             case 's':
                 sval = va_arg(ap, char*);
                 for(; *sval; ++sval) {
-                    serial_write(LOG_COM, *sval);
+                    log_put(line, *sval);
                 }
                 break;
             case '%':
-                serial_write(LOG_COM, '%');
+                log_put(line, '%');
                 break;
         }
     }
 
 }
 
-static void log_printf(char *fmt, ...)
+static void log_printf(log_line_t *line, char *fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
-    log_vprintf(fmt, ap);
+    log_vprintf(line, fmt, ap);
     va_end(ap);
 }
 
-void log_debug(char *fname, char *fmt, ...)
+static char const *level_names[] = { "none", "error", "info", "debug" };
+static char const *subsystem_names[LOG_NUM_SUBSYSTEMS] = {
+    "kernel", "mm", "fs", "sched", "syscall", "dev"
+};
+
+uint8_t log_levels[LOG_NUM_SUBSYSTEMS] = {
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO,
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO
+};
+
+void log_print(uint32_t level, char *fname, char *fmt, ...)
 {
     va_list ap;
-    log_printf("DEBUG: %s: ", fname);
+    log_line_t line;
+    char *prefix = level == LOG_LEVEL_ERROR ? "ERROR" :
+                   level == LOG_LEVEL_INFO ? "INFO" : "DEBUG";
+
+    line.len = 0;
+    line.flags = 0;
+    log_printf(&line, "%s: %s: ", prefix, fname);
     va_start(ap, fmt);
-    log_vprintf(fmt, ap);
+    log_vprintf(&line, fmt, ap);
     va_end(ap);
+    log_flush(&line);
 }
 
-void log_info(char *fname, char *fmt, ...)
+/* @return The index of the name of length len in names, or -1 */
+static int find_name(char const **names, uint32_t n,
+                     char const *name, uint32_t len)
 {
-    va_list ap;
-    log_printf("INFO: %s: ", fname);
-    va_start(ap, fmt);
-    log_vprintf(fmt, ap);
-    va_end(ap);
+    uint32_t i;
+    for (i = 0; i < n; ++i) {
+        if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
 }
 
-void log_error(char *fname, char *fmt, ...)
+void log_parse_levels(char const *levels)
 {
-    va_list ap;
-    log_printf("ERROR: %s: ", fname);
-    va_start(ap, fmt);
-    log_vprintf(fmt, ap);
-    va_end(ap);
+    char const *p = levels, *colon;
+    uint32_t len, i;
+    int subsys, level;
+
+    while (*p != '\0') {
+        len = strcspn(p, ", ");
+        colon = strchr(p, ':');
+
+        if (colon != NULL && colon < p + len) {
+            level = find_name(level_names, 4, colon + 1, p + len - colon - 1);
+            if (colon - p == 3 && strncmp(p, "all", 3) == 0) {
+                subsys = LOG_NUM_SUBSYSTEMS;
+            } else {
+                subsys = find_name(subsystem_names, LOG_NUM_SUBSYSTEMS,
+                                   p, colon - p);
+            }
+
+            if (level == -1 || subsys == -1) {
+                log_error("log_parse_levels", "Bad log level: %s\n", p);
+            } else if (subsys == LOG_NUM_SUBSYSTEMS) {
+                for (i = 0; i < LOG_NUM_SUBSYSTEMS; ++i) {
+                    log_levels[i] = level;
+                }
+            } else {
+                log_levels[subsys] = level;
+            }
+        }
+
+        p += len;
+        if (*p == ',') {
+            ++p;
+        } else if (*p != '\0') {
+            /* the end of the option */
+            break;
+        }
+    }
+}
+
+void log_init(char const *cmdline)
+{
+    char const *opt;
+
+#ifdef LOG_LEVELS
+    log_parse_levels(LOG_LEVELS);
+#endif
+
+    /* look for log= at the start of a word */
+    for (opt = cmdline; opt != NULL && *opt != '\0'; ++opt) {
+        if ((opt == cmdline || opt[-1] == ' ') &&
+            strncmp(opt, "log=", 4) == 0) {
+            log_parse_levels(opt + 4);
+        }
+    }
 }
@@ -2,9 +2,61 @@
 #define LOG_H
 
 #include "stdarg.h"
+#include "stdint.h"
 
-void log_debug(char *fname, char *fmt, ...);
-void log_info(char *fname, char *fmt, ...);
-void log_error(char *fname, char *fmt, ...);
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+/* The most verbose level that is compiled in at all, set it with
+ * make LOG_LEVEL=<n>. Log calls above it are removed by the compiler.
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/* Every source file logs for a subsystem, define LOG_SUBSYSTEM before the
+ * first #include to pick another one than LOG_SUBSYS_KERNEL.
+ */
+#define LOG_SUBSYS_KERNEL   0
+#define LOG_SUBSYS_MM       1
+#define LOG_SUBSYS_FS       2
+#define LOG_SUBSYS_SCHED    3
+#define LOG_SUBSYS_SYSCALL  4
+#define LOG_SUBSYS_DEV      5
+#define LOG_NUM_SUBSYSTEMS  6
+
+#ifndef LOG_SUBSYSTEM
+#define LOG_SUBSYSTEM LOG_SUBSYS_KERNEL
+#endif
+
+/* the current level of each subsystem, see log_parse_levels */
+extern uint8_t log_levels[LOG_NUM_SUBSYSTEMS];
+
+#define LOG_ENABLED(level) \
+    ((level) <= LOG_LEVEL && (level) <= log_levels[LOG_SUBSYSTEM])
+
+#define LOG(level, ...) \
+    do { \
+        if (LOG_ENABLED(level)) { \
+            log_print((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+/* log_x(char *fname, char *fmt, ...) */
+#define log_debug(...)  LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...)   LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_error(...)  LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+void log_print(uint32_t level, char *fname, char *fmt, ...);
+
+/* Sets the levels from a comma separated list of <subsystem>:<level>, e.g.
+ * "all:error,mm:debug". The subsystems are kernel, mm, fs, sched, syscall,
+ * dev and all, the levels are none, error, info and debug.
+ */
+void log_parse_levels(char const *levels);
+/* applies the build time levels and the log= option of the command line */
+void log_init(char const *cmdline);
 
 #endif /* LOG_H */
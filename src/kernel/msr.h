@@ -0,0 +1,14 @@
+#ifndef MSR_H
+#define MSR_H
+
+#include "stdint.h"
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+/* Reads and writes model specific registers, defined in msr_asm.s */
+uint64_t msr_read(uint32_t msr);
+void msr_write(uint32_t msr, uint64_t value);
+
+#endif /* MSR_H */
@@ -0,0 +1,15 @@
+global msr_read
+global msr_write
+
+section .text
+msr_read:
+    mov ecx, [esp+4]    ; the MSR to read
+    rdmsr               ; loads the MSR into edx:eax
+    ret                 ; a 64 bit value is returned in edx:eax by cdecl
+
+msr_write:
+    mov ecx, [esp+4]    ; the MSR to write
+    mov eax, [esp+8]    ; low 32 bits of the value
+    mov edx, [esp+12]   ; high 32 bits of the value
+    wrmsr
+    ret
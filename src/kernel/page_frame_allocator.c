@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_MM
+
 #include "page_frame_allocator.h"
 #include "log.h"
 #include "string.h"
@@ -6,6 +8,7 @@
 #include "mem.h"
 #include "paging.h"
 #include "math.h"
+#include "spinlock.h"
 
 #define MAX_NUM_MEMORY_MAP  100
 
@@ -24,6 +27,8 @@ typedef struct page_frame_bitmap page_frame_bitmap_t;
 static page_frame_bitmap_t page_frames;
 static memory_map_t mmap[MAX_NUM_MEMORY_MAP];
 static uint32_t mmap_len;
+/* protects the bitmap */
+static spinlock_t pfa_lock = SPINLOCK_INIT("pfa");
 
 static uint32_t fill_memory_map(multiboot_info_t const *mbinfo,
                                 kernel_meminfo_t const *mem,
@@ -73,7 +78,7 @@ static uint32_t fill_memory_map(multiboot_info_t const *mbinfo,
 
 static uint32_t construct_bitmap(memory_map_t *mmap, uint32_t n)
 {
-    uint32_t i, bitmap_pfs, bitmap_size, paddr, vaddr, mapped_mem;
+    uint32_t i, bitmap_pfs, bitmap_size, paddr, vaddr;
     uint32_t total_pfs = 0;
 
     /* calculate number of available page frames */
@@ -103,30 +108,20 @@ static uint32_t construct_bitmap(memory_map_t *mmap, uint32_t n)
         return 1;
     }
 
-    vaddr = pdt_kernel_find_next_vaddr(bitmap_size);
+    vaddr = pdt_kernel_map_next(paddr, bitmap_size,
+                                PAGING_PL0, PAGING_READ_WRITE);
     if (vaddr == 0) {
         log_error("construct_bitmap",
-                  "Could not find virtual address for bitmap in kernel. "
-                  "paddr: %X, bitmap_size: %u, bitmap_pfs: %u\n",
+                  "Could not map kernel memory for bitmap. "
+                  "paddr: %X, bitmap_size: %u\n",
                   paddr, bitmap_size);
         return 1;
-
     }
-    log_info("construct_bitmap",
-             "bitmap vaddr: %X, bitmap paddr: %X, page_frames.len: %u, "
-             "bitmap_size: %u, bitmap_pfs: %u\n",
+    log_debug("construct_bitmap",
+              "bitmap vaddr: %X, bitmap paddr: %X, page_frames.len: %u, "
+              "bitmap_size: %u, bitmap_pfs: %u\n",
               vaddr, paddr, page_frames.len, bitmap_size, bitmap_pfs);
 
-    mapped_mem = pdt_map_kernel_memory(paddr, vaddr, bitmap_size,
-                                       PAGING_PL0, PAGING_READ_WRITE);
-    if (mapped_mem < bitmap_size) {
-        log_error("construct_bitmap",
-                  "Could not map kernel memory for bitmap. "
-                  "paddr: %X, vaddr: %X, bitmap_size: %u\n",
-                  paddr, vaddr, bitmap_size);
-        return 1;
-    }
-
     page_frames.start = (uint32_t *) vaddr;
 
     memset(page_frames.start, 0xFF, bitmap_size);
@@ -150,7 +145,7 @@ uint32_t pfa_init(multiboot_info_t const *mbinfo,
         return 1;
     }
 
-    log_info("pfa_init",
+    log_debug("pfa_init",
               "\n\tkernel_physical_start: %X\n"
               "\tkernel_physical_end: %X\n"
               "\tkernel_virtual_start: %X\n"
@@ -239,9 +234,10 @@ static uint32_t fits_in_one_mmap_entry(uint32_t bit_idx, uint32_t pfs)
 
 uint32_t pfa_allocate(uint32_t num_page_frames)
 {
-    uint32_t i, j, cell, bit_idx;
+    uint32_t i, j, cell, bit_idx, flags;
     uint32_t n = div_ceil(page_frames.len, 32), frames_found = 0;
 
+    flags = spin_lock_irqsave(&pfa_lock);
     for (i = 0; i < n; ++i) {
         cell = page_frames.start[i];
         if (cell != 0) {
@@ -254,6 +250,7 @@ uint32_t pfa_allocate(uint32_t num_page_frames)
                     if (frames_found == num_page_frames) {
                         if (fits_in_one_mmap_entry(bit_idx, num_page_frames)) {
                             toggle_bits(bit_idx, num_page_frames);
+                            spin_unlock_irqrestore(&pfa_lock, flags);
                             return paddr_for_idx(bit_idx);
                         } else {
                             frames_found = 0;
@@ -267,17 +264,21 @@ uint32_t pfa_allocate(uint32_t num_page_frames)
             frames_found = 0;
         }
     }
+    spin_unlock_irqrestore(&pfa_lock, flags);
 
     return 0;
 }
 
 void pfa_free(uint32_t paddr)
 {
+    uint32_t flags;
     uint32_t bit_idx = idx_for_paddr(paddr);
     if (bit_idx == page_frames.len) {
         log_error("pfa_free", "invalid paddr %X\n", paddr);
     } else {
+        flags = spin_lock_irqsave(&pfa_lock);
         toggle_bit(bit_idx);
+        spin_unlock_irqrestore(&pfa_lock, flags);
     }
 }
 
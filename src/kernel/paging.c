@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_MM
+
 #include "string.h"
 #include "stdint.h"
 #include "stdio.h"
@@ -6,6 +8,10 @@
 #include "mem.h"
 #include "constants.h"
 #include "page_frame_allocator.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "apic.h"
+#include "interrupt.h"
 
 #define NUM_ENTRIES 1024
 #define PDT_SIZE NUM_ENTRIES * sizeof(pde_t)
@@ -19,15 +25,33 @@
 #define PS_4KB 0x00
 #define PS_4MB 0x01
 
-#define IS_ENTRY_PRESENT(e) ((e)->config && 0x01)
+/* an unmapped kernel page that other CPUs might still have in their TLBs,
+ * the processor ignores all other bits of a non-present entry
+ */
+#define PTE_STALE 0x02
+
+/* what pt_unmap_memory does with the entries */
+#define UNMAP_CLEAR     0 /* present entries are cleared */
+#define UNMAP_STALE     1 /* present entries are made stale */
+#define UNMAP_RELEASE   2 /* stale entries are cleared */
+
+#define IS_ENTRY_PRESENT(e) ((e)->config & 0x01)
+#define IS_ENTRY_STALE(e) ((e)->config == PTE_STALE)
 #define IS_ENTRY_PAGE_TABLE(e) (((e)->config && 0x80) == 0)
 
 #define PT_ENTRY_SIZE  FOUR_KB
 #define PDT_ENTRY_SIZE FOUR_MB
 
-#define KERNEL_TMP_PT_IDX   1023
-#define KERNEL_TMP_VADDR \
-    (KERNEL_START_VADDR + KERNEL_TMP_PT_IDX * PT_ENTRY_SIZE)
+/* every CPU has its own temporary entry at the end of the kernel PT, it may
+ * only be used with interrupts disabled so that the code isn't moved to
+ * another CPU
+ */
+#define KERNEL_TMP_PT_IDX(cpu)  (NUM_ENTRIES - 1 - (cpu))
+#define KERNEL_TMP_VADDR(cpu) \
+    (KERNEL_START_VADDR + KERNEL_TMP_PT_IDX(cpu) * PT_ENTRY_SIZE)
+#define IS_KERNEL_TMP_PT_IDX(pdt_idx, pt_idx) \
+    ((pdt_idx) == KERNEL_PT_PDT_IDX && \
+     (pt_idx) > KERNEL_TMP_PT_IDX(SMP_MAX_CPUS))
 #define KERNEL_PT_PDT_IDX VIRTUAL_TO_PDT_IDX(KERNEL_START_VADDR)
 
 /* pde: page directory entry */
@@ -48,9 +72,19 @@ typedef struct pte pte_t;
 
 static pde_t *kernel_pdt;
 static pte_t *kernel_pt;
+/* protects all page tables and the temporary entries */
+static spinlock_t paging_lock = SPINLOCK_INIT("paging");
+
+/* A CPU that wants the others to flush their TLBs increments their request
+ * counters and sends them APIC_TLB_INT_IDX. A CPU that flushes stores the
+ * request counter it read before the flush in its flush counter.
+ */
+static volatile uint32_t tlb_requests[SMP_MAX_CPUS];
+static volatile uint32_t tlb_flushes[SMP_MAX_CPUS];
 
 extern void pdt_set(uint32_t pdt_addr); /* defined in paging_asm.s */
 extern void invalidate_page_table_entry(uint32_t vaddr);
+extern void tlb_flush(void);
 
 
 static void create_pdt_entry(pde_t *pdt,
@@ -87,21 +121,23 @@ static uint32_t get_pf_paddr(pte_t *pt, uint32_t pt_idx)
 
 static uint32_t kernel_map_temporary_memory(uint32_t paddr)
 {
-    create_pt_entry(kernel_pt, KERNEL_TMP_PT_IDX, paddr,
+    uint32_t cpu = smp_cpu_id();
+    create_pt_entry(kernel_pt, KERNEL_TMP_PT_IDX(cpu), paddr,
                     PAGING_READ_WRITE, PAGING_PL0);
-    invalidate_page_table_entry(KERNEL_TMP_VADDR);
-    return KERNEL_TMP_VADDR;
+    invalidate_page_table_entry(KERNEL_TMP_VADDR(cpu));
+    return KERNEL_TMP_VADDR(cpu);
 }
 
 static uint32_t kernel_get_temporary_entry()
 {
-    return *((uint32_t *) &kernel_pt[KERNEL_TMP_PT_IDX]);
+    return *((uint32_t *) &kernel_pt[KERNEL_TMP_PT_IDX(smp_cpu_id())]);
 }
 
 static void kernel_set_temporary_entry(uint32_t entry)
 {
-    kernel_pt[KERNEL_TMP_PT_IDX] = *((pte_t *) &entry);
-    invalidate_page_table_entry(KERNEL_TMP_VADDR);
+    uint32_t cpu = smp_cpu_id();
+    kernel_pt[KERNEL_TMP_PT_IDX(cpu)] = *((pte_t *) &entry);
+    invalidate_page_table_entry(KERNEL_TMP_VADDR(cpu));
 }
 
 /* The given pdt must be mapped somwhere in the kernels page table,
@@ -127,13 +163,66 @@ static uint32_t get_pdt_paddr(pde_t *pdt)
     return pdt_paddr;
 }
 
+static void tlb_flush_if_requested(uint32_t cpu)
+{
+    uint32_t requested = tlb_requests[cpu];
+    if (requested != tlb_flushes[cpu]) {
+        tlb_flush();
+        tlb_flushes[cpu] = requested;
+    }
+}
+
+static void tlb_handle_interrupt(cpu_state_t cpu, idt_info_t info,
+                                 stack_state_t stack)
+{
+    UNUSED_ARGUMENT(cpu);
+    UNUSED_ARGUMENT(info);
+    UNUSED_ARGUMENT(stack);
+
+    tlb_flush_if_requested(smp_cpu_id());
+    apic_eoi();
+}
+
+/* Makes all other CPUs flush their TLBs and waits until they have. Must not
+ * be called with a spinlock held, a CPU spinning on it with interrupts
+ * disabled would never take the interrupt.
+ */
+static void tlb_shootdown(void)
+{
+    uint32_t i, self, flags, num_cpus = smp_num_cpus();
+    uint32_t wanted[SMP_MAX_CPUS];
+
+    if (num_cpus == 1) {
+        return;
+    }
+
+    flags = interrupts_save_and_disable();
+    self = smp_cpu_id();
+    for (i = 0; i < num_cpus; ++i) {
+        if (i != self) {
+            wanted[i] = atomic_fetch_add(&tlb_requests[i], 1) + 1;
+        }
+    }
+    apic_send_to_others(APIC_TLB_INT_IDX);
+
+    for (i = 0; i < num_cpus; ++i) {
+        while (i != self && (int) (tlb_flushes[i] - wanted[i]) < 0) {
+            /* the other CPU might be waiting for us at the same time */
+            tlb_flush_if_requested(self);
+            smp_pause();
+        }
+    }
+    interrupts_restore(flags);
+}
+
 uint32_t paging_init(uint32_t kernel_pdt_vaddr, uint32_t kernel_pt_vaddr)
 {
     log_info("paging_init", "kernel_pdt_vaddr: %X, kernel_pt_vaddr: %X\n",
                      kernel_pdt_vaddr, kernel_pt_vaddr);
     kernel_pdt = (pde_t *) kernel_pdt_vaddr;
     kernel_pt = (pte_t *) kernel_pt_vaddr;
-    return 0;
+    return register_interrupt_handler(APIC_TLB_INT_IDX,
+                                      &tlb_handle_interrupt);
 }
 
 static uint32_t pt_kernel_find_next_vaddr(uint32_t pdt_idx,
@@ -143,8 +232,8 @@ static uint32_t pt_kernel_find_next_vaddr(uint32_t pdt_idx,
     num_to_find = align_up(size, FOUR_KB) / FOUR_KB;
 
     for (i = 0; i < NUM_ENTRIES; ++i) {
-        if (IS_ENTRY_PRESENT(pt+i) ||
-            (pdt_idx == KERNEL_PT_PDT_IDX && i == KERNEL_TMP_PT_IDX)) {
+        if (IS_ENTRY_PRESENT(pt+i) || IS_ENTRY_STALE(pt+i) ||
+            IS_KERNEL_TMP_PT_IDX(pdt_idx, i)) {
             num_found = 0;
         } else {
             if (num_found == 0) {
@@ -160,7 +249,7 @@ static uint32_t pt_kernel_find_next_vaddr(uint32_t pdt_idx,
     return 0;
 }
 
-uint32_t pdt_kernel_find_next_vaddr(uint32_t size)
+static uint32_t kernel_find_next_vaddr(uint32_t size)
 {
     uint32_t pdt_idx, pt_paddr, pt_vaddr, tmp_entry, vaddr = 0;
     /* TODO: support > 4MB sizes */
@@ -206,7 +295,8 @@ static uint32_t pt_map_memory(pte_t *pt,
                      "pt[pt_idx]: %X\n",
                      pt, pt_idx, pdt_idx, pt[pt_idx]);
             return mapped_size;
-        } else if(pdt_idx == KERNEL_PT_PDT_IDX && pt_idx == KERNEL_TMP_PT_IDX) {
+        } else if (IS_KERNEL_TMP_PT_IDX(pdt_idx, pt_idx) ||
+                   IS_ENTRY_STALE(pt + pt_idx)) {
             return mapped_size;
         }
 
@@ -220,12 +310,12 @@ static uint32_t pt_map_memory(pte_t *pt,
     return mapped_size;
 }
 
-uint32_t pdt_map_memory(pde_t *pdt,
-                        uint32_t paddr,
-                        uint32_t vaddr,
-                        uint32_t size,
-                        uint8_t rw,
-                        uint8_t pl)
+static uint32_t map_memory(pde_t *pdt,
+                           uint32_t paddr,
+                           uint32_t vaddr,
+                           uint32_t size,
+                           uint8_t rw,
+                           uint8_t pl)
 {
     uint32_t pdt_idx;
     pte_t *pt;
@@ -284,6 +374,20 @@ uint32_t pdt_map_memory(pde_t *pdt,
     return total_mapped_size;
 }
 
+uint32_t pdt_map_memory(pde_t *pdt,
+                        uint32_t paddr,
+                        uint32_t vaddr,
+                        uint32_t size,
+                        uint8_t rw,
+                        uint8_t pl)
+{
+    uint32_t flags = spin_lock_irqsave(&paging_lock);
+    uint32_t mapped = map_memory(pdt, paddr, vaddr, size, rw, pl);
+    spin_unlock_irqrestore(&paging_lock, flags);
+
+    return mapped;
+}
+
 uint32_t pdt_map_kernel_memory(uint32_t paddr,
                                uint32_t vaddr,
                                uint32_t size,
@@ -297,18 +401,26 @@ uint32_t pdt_map_kernel_memory(uint32_t paddr,
 static uint32_t pt_unmap_memory(pte_t *pt,
 			        uint32_t pdt_idx,
                                 uint32_t vaddr,
-                                uint32_t size)
+                                uint32_t size,
+                                uint8_t how)
 {
     uint32_t pt_idx = VIRTUAL_TO_PT_IDX(vaddr);
     uint32_t freed_size = 0;
 
     while (freed_size < size && pt_idx < NUM_ENTRIES) {
-        if (pdt_idx == KERNEL_PT_PDT_IDX && pt_idx == KERNEL_TMP_PT_IDX) {
+        if (IS_KERNEL_TMP_PT_IDX(pdt_idx, pt_idx)) {
             /* can't touch this */
             return freed_size;
         }
-        if (IS_ENTRY_PRESENT(pt + pt_idx)) {
+        if (how == UNMAP_RELEASE) {
+            if (IS_ENTRY_STALE(pt + pt_idx)) {
+                memset(pt + pt_idx, 0, sizeof(pte_t));
+            }
+        } else if (IS_ENTRY_PRESENT(pt + pt_idx)) {
             memset(pt + pt_idx, 0, sizeof(pte_t));
+            if (how == UNMAP_STALE) {
+                pt[pt_idx].config = PTE_STALE;
+            }
             invalidate_page_table_entry(vaddr);
         }
 
@@ -320,7 +432,8 @@ static uint32_t pt_unmap_memory(pte_t *pt,
     return freed_size;
 }
 
-uint32_t pdt_unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size)
+static uint32_t unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size,
+                             uint8_t how)
 {
     uint32_t pdt_idx, pt_paddr, pt_vaddr, tmp_entry;
 
@@ -344,11 +457,12 @@ uint32_t pdt_unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size)
         pt_vaddr = kernel_map_temporary_memory(pt_paddr);
 
         freed_size =
-            pt_unmap_memory((pte_t *) pt_vaddr, pdt_idx, vaddr, size);
+            pt_unmap_memory((pte_t *) pt_vaddr, pdt_idx, vaddr, size, how);
 
         kernel_set_temporary_entry(tmp_entry);
 
-        if (freed_size == PDT_ENTRY_SIZE) {
+        /* a page table with stale entries is still in use */
+        if (freed_size == PDT_ENTRY_SIZE && how == UNMAP_CLEAR) {
             if (pdt_idx != KERNEL_PT_PDT_IDX) {
                 pfa_free(pt_paddr);
                 memset(pdt + pdt_idx, 0, sizeof(pde_t));
@@ -361,9 +475,52 @@ uint32_t pdt_unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size)
     return freed_size;
 }
 
+uint32_t pdt_unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size)
+{
+    uint32_t flags = spin_lock_irqsave(&paging_lock);
+    uint32_t freed = unmap_memory(pdt, vaddr, size, UNMAP_CLEAR);
+    spin_unlock_irqrestore(&paging_lock, flags);
+
+    return freed;
+}
+
+uint32_t pdt_kernel_map_next(uint32_t paddr, uint32_t size,
+                             uint8_t rw, uint8_t pl)
+{
+    uint32_t mapped, vaddr;
+    uint32_t flags = spin_lock_irqsave(&paging_lock);
+
+    vaddr = kernel_find_next_vaddr(size);
+    if (vaddr != 0) {
+        mapped = map_memory(kernel_pdt, paddr, vaddr, size, rw, pl);
+        if (mapped < size) {
+            /* nobody has used the mapping yet, so no CPU has it cached */
+            unmap_memory(kernel_pdt, vaddr, mapped, UNMAP_CLEAR);
+            vaddr = 0;
+        }
+    }
+
+    spin_unlock_irqrestore(&paging_lock, flags);
+    return vaddr;
+}
+
+/* The kernel mappings are shared by all CPUs. The entries stay stale, so
+ * that the virtual addresses can't be reused, until every CPU has flushed its
+ * TLB. After that the caller can free the page frames.
+ */
 uint32_t pdt_unmap_kernel_memory(uint32_t virtual_addr, uint32_t size)
 {
-    return pdt_unmap_memory(kernel_pdt, virtual_addr, size);
+    uint32_t freed, flags = spin_lock_irqsave(&paging_lock);
+    freed = unmap_memory(kernel_pdt, virtual_addr, size, UNMAP_STALE);
+    spin_unlock_irqrestore(&paging_lock, flags);
+
+    tlb_shootdown();
+
+    flags = spin_lock_irqsave(&paging_lock);
+    unmap_memory(kernel_pdt, virtual_addr, size, UNMAP_RELEASE);
+    spin_unlock_irqrestore(&paging_lock, flags);
+
+    return freed;
 }
 
 /* OUT paddr: The physical address for the PDT */
@@ -372,13 +529,9 @@ pde_t *pdt_create(uint32_t *out_paddr)
     pde_t *pdt;
     *out_paddr = 0;
     uint32_t pdt_paddr = pfa_allocate(1);
-    uint32_t pdt_vaddr = pdt_kernel_find_next_vaddr(PDT_SIZE);
-    uint32_t size = pdt_map_kernel_memory(pdt_paddr, pdt_vaddr, PDT_SIZE,
-                                          PAGING_READ_WRITE, PAGING_PL0);
-    if (size < PDT_SIZE) {
-        /* Since PDT_SIZE is the size of one frame, size must either be equal
-         * to PDT_SIZE or 0
-         */
+    uint32_t pdt_vaddr = pdt_kernel_map_next(pdt_paddr, PDT_SIZE,
+                                             PAGING_READ_WRITE, PAGING_PL0);
+    if (pdt_vaddr == 0) {
         pfa_free(pdt_paddr);
         return NULL;
     }
@@ -393,18 +546,46 @@ pde_t *pdt_create(uint32_t *out_paddr)
 
 void pdt_delete(pde_t *pdt)
 {
-    uint32_t i, pdt_paddr;
+    uint32_t i, pdt_paddr, flags;
     for (i = 0; i < NUM_ENTRIES; ++i) {
         if (IS_ENTRY_PRESENT(pdt + i) && IS_ENTRY_PAGE_TABLE(pdt + i)) {
             pfa_free(get_pt_paddr(pdt, i));
         }
     }
 
+    flags = spin_lock_irqsave(&paging_lock);
     pdt_paddr = get_pdt_paddr(pdt);
+    spin_unlock_irqrestore(&paging_lock, flags);
+
+    pdt_unmap_kernel_memory((uint32_t) pdt, PDT_SIZE);
     pfa_free(pdt_paddr);
 }
 
+uint32_t paging_kernel_pdt_paddr(void)
+{
+    /* the kernel PDT is statically allocated in loader.s */
+    return (uint32_t) kernel_pdt - KERNEL_START_VADDR;
+}
+
+void paging_set_identity_map(uint8_t enable)
+{
+    uint32_t flags = spin_lock_irqsave(&paging_lock);
+    if (enable) {
+        create_pdt_entry(kernel_pdt, 0, 0, PS_4MB,
+                         PAGING_READ_WRITE, PAGING_PL0);
+    } else {
+        memset(kernel_pdt, 0, sizeof(pde_t));
+    }
+    invalidate_page_table_entry(0);
+    spin_unlock_irqrestore(&paging_lock, flags);
+}
+
 void pdt_set(uint32_t pdt_paddr);
+void pdt_load_kernel_pdt(void)
+{
+    pdt_set(paging_kernel_pdt_paddr());
+}
+
 void pdt_load_process_pdt(pde_t *pdt, uint32_t pdt_paddr)
 {
     uint32_t i;
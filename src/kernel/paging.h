@@ -12,7 +12,11 @@ typedef struct pde pde_t;
 
 uint32_t paging_init(uint32_t kernel_pdt_vaddr, uint32_t kernel_pt_vaddr);
 
-uint32_t pdt_kernel_find_next_vaddr(uint32_t size);
+/* Maps size bytes at paddr at the first free virtual address in the kernel
+ * @return The virtual address, or 0 if the memory couldn't be mapped
+ */
+uint32_t pdt_kernel_map_next(uint32_t paddr, uint32_t size,
+                             uint8_t rw, uint8_t pl);
 
 uint32_t pdt_map_kernel_memory(uint32_t paddr,
                                uint32_t vaddr,
@@ -26,6 +30,9 @@ uint32_t pdt_map_memory(pde_t *pdt,
                         uint8_t rw,
                         uint8_t pl);
 
+/* Waits for the other CPUs to flush their TLBs, so the page frames can be
+ * freed once it returns. Must not be called with a spinlock held.
+ */
 uint32_t pdt_unmap_kernel_memory(uint32_t vaddr, uint32_t size);
 uint32_t pdt_unmap_memory(pde_t *pdt, uint32_t vaddr, uint32_t size);
 
@@ -33,5 +40,12 @@ pde_t *pdt_create(uint32_t *out_paddr);
 void pdt_delete(pde_t *pdt);
 
 void pdt_load_process_pdt(pde_t *pdt, uint32_t pdt_paddr);
+void pdt_load_kernel_pdt(void);
+
+uint32_t paging_kernel_pdt_paddr(void);
+/* Identity maps (or unmaps) the lowest 4 MB in the kernel PDT, like loader.s
+ * does while booting. Needed by the APs while they enable paging.
+ */
+void paging_set_identity_map(uint8_t enable);
 
 #endif /* PAGING_H */
@@ -1,5 +1,6 @@
 global pdt_set
 global invalidate_page_table_entry
+global tlb_flush
 
 section .text:
 
@@ -15,3 +16,8 @@ invalidate_page_table_entry:
                         ; will be flushed
     invlpg [eax]
     ret
+
+tlb_flush:
+    mov eax, cr3        ; writing cr3 flushes the whole TLB, no pages are
+    mov cr3, eax        ; marked as global
+    ret
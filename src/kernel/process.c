@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SCHED
+
 #include "process.h"
 #include "vfs.h"
 #include "kmalloc.h"
@@ -45,27 +47,16 @@ static int process_load_code(ps_t *ps, char const *path, uint32_t vaddr)
         return -1;
     }
 
-    kernel_vaddr = pdt_kernel_find_next_vaddr(attr.file_size);
+    kernel_vaddr = pdt_kernel_map_next(paddr, attr.file_size,
+                                       PAGING_READ_WRITE, PAGING_PL0);
     if (kernel_vaddr == 0) {
         log_error("process_load_code",
-                  "Could not find virtual memory for proc code in kernel. "
+                  "Could not map memory for proc code in kernel. "
                   "paddr: %X, size: %u\n", paddr, attr.file_size);
         return -1;
     }
 
-    mapped_memory_size =
-        pdt_map_kernel_memory(paddr, kernel_vaddr, attr.file_size,
-                              PAGING_READ_WRITE, PAGING_PL0);
-    if (mapped_memory_size < attr.file_size) {
-        pdt_unmap_kernel_memory(kernel_vaddr, attr.file_size);
-        log_error("process_load_code",
-                  "Could not map memory in kernel. "
-                  "kernel_vaddr: %X, paddr: %X, size: %u\n",
-                  kernel_vaddr, paddr, attr.file_size);
-        return -1;
-    }
-
-    if(vfs_read(&node, (void *) kernel_vaddr, attr.file_size) !=
+    if(vfs_read(&node, (void *) kernel_vaddr, attr.file_size, 0) !=
        (int) attr.file_size) {
         pdt_unmap_kernel_memory(kernel_vaddr, attr.file_size);
         log_error("process_load_code",
@@ -153,7 +144,7 @@ static int process_load_stack(ps_t *ps)
 
 static int process_load_kernel_stack(ps_t *ps)
 {
-    uint32_t pfs, bytes, vaddr, paddr, mapped_memory_size;
+    uint32_t pfs, bytes, vaddr, paddr;
     paddr_ele_t *kernel_stack_paddrs;
 
     pfs = div_ceil(KERNEL_STACK_SIZE, FOUR_KB);
@@ -165,22 +156,12 @@ static int process_load_kernel_stack(ps_t *ps)
     }
 
     bytes = pfs * FOUR_KB;
-    vaddr = pdt_kernel_find_next_vaddr(bytes);
+    vaddr = pdt_kernel_map_next(paddr, bytes, PAGING_READ_WRITE, PAGING_PL0);
     if (vaddr == 0) {
-        log_error("process_load_kernel_stack",
-                  "Could not find virtual address for kernel stack."
-                  "bytes: %u\n", bytes);
-        return -1;
-    }
-
-    mapped_memory_size =
-        pdt_map_kernel_memory(paddr, vaddr, bytes, PAGING_READ_WRITE,
-                              PAGING_PL0);
-    if (mapped_memory_size != bytes) {
         log_error("process_load_kernel_stack",
                   "Could not map memory for kernel stack."
-                  "paddr: %X, vaddr: %X, bytes: %u\n",
-                  paddr, vaddr, bytes);
+                  "paddr: %X, bytes: %u\n",
+                  paddr, bytes);
         return -1;
     }
 
@@ -219,6 +200,15 @@ static int process_load_pdt(ps_t *ps)
     ps->pdt = pdt;
     ps->pdt_paddr = paddr;
 
+    ps->kdata = kdata_ps_create(pdt, &ps->kdata_paddr);
+    if (ps->kdata == NULL) {
+        log_error("process_load_pdt",
+                  "Could not create the kdata page for process %u\n", ps->id);
+        return -1;
+    }
+    ps->kdata->pid = ps->id;
+    ps->kdata->ppid = ps->parent_id;
+
     return 0;
 }
 
@@ -241,15 +231,27 @@ static uint32_t delete_paddr_list(paddr_list_t *l)
 
 void process_delete_resources(ps_t *ps)
 {
-    uint32_t size, i;
+    uint32_t i;
 
     if (ps->pdt != 0) {
         pdt_delete(ps->pdt);
     }
 
+    if (ps->ring != NULL) {
+        ring_delete(ps->ring);
+        ps->ring = NULL;
+    }
+
+    if (ps->kdata != NULL) {
+        kdata_ps_delete(ps->kdata, ps->kdata_paddr);
+        ps->kdata = NULL;
+    }
+
     if (ps->kernel_stack_start_vaddr != 0) {
-        size = delete_paddr_list(&ps->kernel_stack_paddrs);
-        pdt_unmap_kernel_memory(ps->kernel_stack_start_vaddr, size);
+        /* unmapped first, no CPU may use the frames once they are freed */
+        pdt_unmap_kernel_memory(ps->kernel_stack_start_vaddr,
+                                KERNEL_STACK_SIZE);
+        delete_paddr_list(&ps->kernel_stack_paddrs);
     }
 
     delete_paddr_list(&ps->code_paddrs);
@@ -274,6 +276,21 @@ static void process_init(ps_t *ps, uint32_t id)
 {
     ps->id = id;
     ps->parent_id = 0;
+    ps->state = PROCESS_STATE_NEW;
+    ps->parent = NULL;
+    ps->children = NULL;
+    ps->zombies = NULL;
+    ps->sibling_next = NULL;
+    ps->sibling_prev = NULL;
+    ps->num_children = 0;
+    ps->pid_next = NULL;
+    ps->run_next = NULL;
+    ps->run_prev = NULL;
+    ps->wait_next = NULL;
+    ps->slice_left = 0;
+    ps->deadline = 0;
+    ps->budget_left = 0;
+    ps->cpu = 0;
     ps->pdt = 0;
     ps->pdt_paddr = 0;
     ps->kernel_stack_start_vaddr = 0;
@@ -289,6 +306,13 @@ static void process_init(ps_t *ps, uint32_t id)
     memset(ps->file_descriptors, 0, PROCESS_MAX_NUM_FD * sizeof(fd_t));
     memset(&ps->user_mode, 0, sizeof(registers_t));
     memset(&ps->current, 0, sizeof(registers_t));
+    fpu_state_init(&ps->fpu);
+    ps->ring = NULL;
+    ps->kdata = NULL;
+    ps->kdata_paddr = 0;
+    memset(&ps->stat, 0, sizeof(schedstat_t));
+    memset(&ps->rusage, 0, sizeof(rusage_t));
+    memset(&ps->sched, 0, sizeof(sched_param_t)); /* SCHED_NORMAL, nice 0 */
 
     ps->user_mode.eflags = REG_EFLAGS_DEFAULT;
     ps->user_mode.ss = (SEGSEL_USER_SPACE_DS | 0x03);
@@ -340,6 +364,33 @@ ps_t *process_create(char const *path, uint32_t id)
     return ps;
 }
 
+ps_t *process_create_kernel(uint32_t id)
+{
+    ps_t *ps;
+
+    ps = (ps_t *) kmalloc(sizeof(ps_t));
+    if (ps == NULL) {
+        log_error("process_create_kernel",
+                  "kmalloc return NULL pointer for proc.\n");
+        return NULL;
+    }
+
+    process_init(ps, id);
+
+    if (process_load_kernel_stack(ps)) {
+        log_error("process_create_kernel",
+                  "Couldn't load kernel stack for process %u\n", id);
+        process_delete_and_free(ps);
+        return NULL;
+    }
+
+    ps->current.cs = SEGSEL_KERNEL_CS;
+    ps->current.ss = SEGSEL_KERNEL_DS;
+    ps->current.eflags = REG_EFLAGS_DEFAULT;
+    ps->current.esp = ps->kernel_stack_start_vaddr;
+    return ps;
+}
+
 static int process_copy_file_descriptors(ps_t *from, ps_t *to)
 {
     vnode_t *copy;
@@ -355,6 +406,7 @@ static int process_copy_file_descriptors(ps_t *from, ps_t *to)
             }
             vnode_copy(from->file_descriptors[i].vnode, copy);
             to->file_descriptors[i].vnode = copy;
+            to->file_descriptors[i].offset = from->file_descriptors[i].offset;
         }
     }
 
@@ -373,7 +425,7 @@ ps_t *process_create_replacement(ps_t *parent, char const *path)
         return NULL;
     }
 
-    child->parent_id = parent->parent_id;
+    process_set_parent_id(child, parent->parent_id);
 
     /* copy the old data */
     if (process_copy_file_descriptors(parent, child)) {
@@ -403,23 +455,12 @@ static int process_copy_paddr_list(pde_t *pdt, uint32_t vaddr,
         }
 
         bytes = p->count * FOUR_KB;
-        kernel_vaddr = pdt_kernel_find_next_vaddr(bytes);
+        kernel_vaddr = pdt_kernel_map_next(paddr, bytes,
+                                           PAGING_READ_WRITE, PAGING_PL0);
         if (kernel_vaddr == 0) {
-            log_error("process_copy_paddr_list",
-                      "Could not find virtual memory for proc code in kernel. "
-                      "paddr: %X, bytes: %u\n", paddr, bytes);
-            pfa_free_cont(paddr, p->count);
-            return -1;
-        }
-
-        mapped = pdt_map_kernel_memory(paddr, kernel_vaddr, bytes,
-                                       PAGING_READ_WRITE, PAGING_PL0);
-        if (mapped < bytes) {
             log_error("process_copy_paddr_list",
                       "Could not map memory in kernel. "
-                      "kernel_vaddr: %X, paddr: %X, bytes: %u\n",
-                      kernel_vaddr, paddr, bytes);
-            pdt_unmap_kernel_memory(kernel_vaddr, bytes);
+                      "paddr: %X, bytes: %u\n", paddr, bytes);
             pfa_free_cont(paddr, p->count);
             return -1;
         }
@@ -476,10 +517,11 @@ ps_t *process_clone(ps_t *parent, uint32_t id)
         return NULL;
     }
     process_init(child, id);
-    child->parent_id = parent->id;
+    child->parent_id = parent->id; /* before the kdata page is created */
 
     /* copy user mode registers */
     child->user_mode = parent->user_mode;
+    fpu_copy(&child->fpu, &parent->fpu);
 
     /* create a new PDT */
     error = process_load_pdt(child);
@@ -536,5 +578,24 @@ ps_t *process_clone(ps_t *parent, uint32_t id)
         return NULL;
     }
 
+    /* the child's libc still points at the ring, so it gets a copy */
+    if (parent->ring != NULL) {
+        child->ring = ring_clone(parent->ring, child->pdt);
+        if (child->ring == NULL) {
+            log_error("process_clone", "Couldn't copy the ring. "
+                      "parent: %u, child: %u.\n", parent->id, id);
+            process_delete_and_free(child);
+            return NULL;
+        }
+    }
+
     return child;
 }
+
+void process_set_parent_id(ps_t *ps, uint32_t parent_id)
+{
+    ps->parent_id = parent_id;
+    if (ps->kdata != NULL) {
+        ps->kdata->ppid = parent_id;
+    }
+}
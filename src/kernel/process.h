@@ -4,6 +4,10 @@
 #include "stdint.h"
 #include "vnode.h"
 #include "paging.h"
+#include "schedstat.h"
+#include "fpu.h"
+#include "ring.h"
+#include "kdata.h"
 
 #define PROCESS_MAX_NUM_FD      64
 
@@ -38,20 +42,65 @@ struct paddr_list {
 typedef struct paddr_list paddr_list_t;
 
 
+/* must be kept in sync with libc/sys/resource.h */
+struct rusage {
+    uint32_t utime;     /* time spent in user mode, in ms */
+    uint32_t stime;     /* time spent in kernel mode, in ms */
+    uint32_t nvcsw;     /* voluntary context switches */
+    uint32_t nivcsw;    /* involuntary context switches */
+} __attribute__((packed));
+typedef struct rusage rusage_t;
+
+#define SCHED_NORMAL    0
+#define SCHED_RT        1
+#define SCHED_EDF       2
+
+/* must be kept in sync with libc/sys/sched.h */
+struct sched_param {
+    uint32_t policy;
+    int priority;       /* nice value for SCHED_NORMAL, 0-31 for SCHED_RT */
+    uint32_t period;    /* SCHED_EDF only, in ms */
+    uint32_t budget;    /* SCHED_EDF only, in ms per period */
+} __attribute__((packed));
+typedef struct sched_param sched_param_t;
+
 struct fd {
     vnode_t *vnode;
+    uint32_t offset;    /* where the next read starts */
 };
 typedef struct fd fd_t;
 
+#define PROCESS_STATE_NEW       0
+#define PROCESS_STATE_RUNNABLE  1
+#define PROCESS_STATE_ZOMBIE    2
+#define PROCESS_STATE_BLOCKED   3
+
 struct ps {
     uint32_t id;
     uint32_t parent_id;
+    uint32_t state;
+
+    /* the links below are owned by the scheduler */
+    struct ps *parent;
+    struct ps *children;        /* live children */
+    struct ps *zombies;         /* terminated children not yet reaped */
+    struct ps *sibling_next;
+    struct ps *sibling_prev;
+    uint32_t num_children;      /* live + zombie children */
+    struct ps *pid_next;        /* next ps in the same pid hash bucket */
+    struct ps *run_next;
+    struct ps *run_prev;
+    struct ps *wait_next;       /* next ps in the same wait queue */
 
     pde_t *pdt;
     uint32_t pdt_paddr;
 
     registers_t current;
     registers_t user_mode;
+    fpu_state_t fpu;
+    ring_t *ring;               /* NULL until SYS_ring_setup */
+    kdata_ps_t *kdata;          /* NULL for kernel threads */
+    uint32_t kdata_paddr;
 
     uint32_t kernel_stack_start_vaddr;
     uint32_t stack_start_vaddr;
@@ -62,10 +111,21 @@ struct ps {
     paddr_list_t code_paddrs;
     paddr_list_t stack_paddrs;
     paddr_list_t kernel_stack_paddrs;
+
+    sched_param_t sched;
+    uint32_t slice_left;        /* in ms */
+    uint32_t deadline;          /* SCHED_EDF only, absolute time in ms */
+    uint32_t budget_left;       /* SCHED_EDF only, in ms */
+    uint32_t cpu;               /* the CPU whose run queue the ps is in */
+
+    schedstat_t stat;
+    rusage_t rusage;
 };
 typedef struct ps ps_t;
 
 ps_t *process_create(char const *path, uint32_t id);
+/* a process without PDT and user mode, current must be set up by the caller */
+ps_t *process_create_kernel(uint32_t id);
 ps_t *process_replace(ps_t *ps, char const *path);
 
 /*
@@ -77,5 +137,7 @@ ps_t *process_create_replacement(ps_t *parent, char const *path);
 ps_t *process_clone(ps_t *parent, uint32_t pid);
 void process_mark_as_user(ps_t *ps);
 void process_mark_as_kernel(ps_t *ps);
+/* also updates the ppid in the process' kdata page */
+void process_set_parent_id(ps_t *ps, uint32_t parent_id);
 
 #endif /* PROCESS_H */
@@ -0,0 +1,126 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SYSCALL
+
+#include "ring.h"
+#include "kmalloc.h"
+#include "page_frame_allocator.h"
+#include "string.h"
+#include "constants.h"
+#include "stddef.h"
+#include "log.h"
+
+ring_t *ring_create(pde_t *pdt, uint32_t entries)
+{
+    ring_t *ring;
+    uint32_t vaddr, size;
+
+    if (entries == 0 || entries > RING_MAX_ENTRIES ||
+        (entries & (entries - 1)) != 0) {
+        return NULL;
+    }
+
+    ring = kmalloc(sizeof(ring_t));
+    if (ring == NULL) {
+        log_error("ring_create", "Couldn't allocate the ring\n");
+        return NULL;
+    }
+
+    ring->paddr = pfa_allocate(1);
+    if (ring->paddr == 0) {
+        log_error("ring_create", "Couldn't allocate a page frame\n");
+        kfree(ring);
+        return NULL;
+    }
+
+    vaddr = pdt_kernel_map_next(ring->paddr, FOUR_KB,
+                                PAGING_READ_WRITE, PAGING_PL0);
+    if (vaddr == 0) {
+        log_error("ring_create", "Couldn't map the ring in the kernel. "
+                  "paddr: %X\n", ring->paddr);
+        pfa_free(ring->paddr);
+        kfree(ring);
+        return NULL;
+    }
+
+    size = pdt_map_memory(pdt, ring->paddr, RING_USER_VADDR, FOUR_KB,
+                          PAGING_READ_WRITE, PAGING_PL3);
+    if (size < FOUR_KB) {
+        log_error("ring_create", "Couldn't map the ring in the process. "
+                  "paddr: %X\n", ring->paddr);
+        pdt_unmap_kernel_memory(vaddr, FOUR_KB);
+        pfa_free(ring->paddr);
+        kfree(ring);
+        return NULL;
+    }
+
+    memset((void *) vaddr, 0, FOUR_KB);
+    ring->entries = entries;
+    ring->shared = (ring_shared_t *) vaddr;
+    ring->shared->entries = entries;
+    ring->shared->sqes_offset = sizeof(ring_shared_t);
+    ring->shared->cqes_offset = sizeof(ring_shared_t) +
+                                entries * sizeof(ring_sqe_t);
+    ring->sqes = (ring_sqe_t *) (vaddr + ring->shared->sqes_offset);
+    ring->cqes = (ring_cqe_t *) (vaddr + ring->shared->cqes_offset);
+
+    return ring;
+}
+
+ring_t *ring_clone(ring_t *ring, pde_t *pdt)
+{
+    ring_t *copy = ring_create(pdt, ring->entries);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    /* the offsets are the same, so the entries can be copied as they are */
+    memcpy(copy->shared, ring->shared, FOUR_KB);
+
+    return copy;
+}
+
+void ring_delete(ring_t *ring)
+{
+    pdt_unmap_kernel_memory((uint32_t) ring->shared, FOUR_KB);
+    pfa_free(ring->paddr);
+    kfree(ring);
+}
+
+uint32_t ring_submit(ring_t *ring, uint32_t to_submit, ring_exec_t exec)
+{
+    ring_shared_t *shared = ring->shared;
+    uint32_t mask = ring->entries - 1;
+    uint32_t head = shared->sq_head, cq_tail = shared->cq_tail;
+    /* the process might change the tail while we're running, read it once */
+    uint32_t available = shared->sq_tail - head;
+    uint32_t i, n = 0;
+    uint32_t args[RING_MAX_ARGS];
+    ring_sqe_t sqe;
+    ring_cqe_t *cqe;
+
+    if (available > ring->entries) {
+        /* the process has corrupted the tail */
+        return 0;
+    }
+
+    while (n < to_submit && n < available &&
+           cq_tail - shared->cq_head < ring->entries) {
+        /* copy the entry, so the process can't change it under our feet */
+        sqe = ring->sqes[(head + n) & mask];
+
+        for (i = 0; i < RING_MAX_ARGS; ++i) {
+            args[i] = sqe.args[i];
+        }
+
+        cqe = &ring->cqes[cq_tail & mask];
+        cqe->user_data = sqe.user_data;
+        cqe->res = exec(sqe.opcode, args);
+
+        ++cq_tail;
+        ++n;
+        /* publish each completion right away */
+        shared->cq_tail = cq_tail;
+        shared->sq_head = head + n;
+    }
+
+    return n;
+}
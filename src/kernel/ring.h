@@ -0,0 +1,77 @@
+#ifndef RING_H
+#define RING_H
+
+#include "stdint.h"
+#include "paging.h"
+
+/* A submission and a completion queue in one page that is shared between a
+ * process and the kernel. The process queues syscalls as submission queue
+ * entries and submits many of them with a single SYS_ring_enter, the results
+ * are posted as completion queue entries.
+ *
+ * The heads and tails are free running counters, an entry's index is the
+ * counter modulo the number of entries. The process writes sq_tail and
+ * cq_head, the kernel writes sq_head and cq_tail.
+ */
+
+#define RING_USER_VADDR     0x40000000
+#define RING_MAX_ENTRIES    128
+#define RING_MAX_ARGS       3
+
+/* must be kept in sync with libc/sys/ring.h */
+struct ring_sqe {
+    uint32_t opcode;                /* the syscall number */
+    uint32_t args[RING_MAX_ARGS];
+    uint32_t user_data;             /* copied to the completion */
+} __attribute__((packed));
+typedef struct ring_sqe ring_sqe_t;
+
+struct ring_cqe {
+    uint32_t user_data;
+    int res;                        /* the return value of the syscall */
+} __attribute__((packed));
+typedef struct ring_cqe ring_cqe_t;
+
+struct ring_shared {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+    uint32_t sqes_offset;           /* from the start of the page */
+    uint32_t cqes_offset;
+} __attribute__((packed));
+typedef struct ring_shared ring_shared_t;
+
+struct ring {
+    uint32_t paddr;
+    ring_shared_t *shared;          /* the kernel's mapping of the page */
+    ring_sqe_t *sqes;
+    ring_cqe_t *cqes;
+    uint32_t entries;
+};
+typedef struct ring ring_t;
+
+/* runs one submitted syscall, returns its result */
+typedef int (*ring_exec_t)(uint32_t opcode, uint32_t const *args);
+
+/* Creates a ring with entries entries, a power of two, and maps it at
+ * RING_USER_VADDR in pdt.
+ */
+ring_t *ring_create(pde_t *pdt, uint32_t entries);
+/* Creates a copy of ring, with the same entries and counters, mapped at
+ * RING_USER_VADDR in pdt. Used by fork, since the child's copy of the
+ * process's memory still refers to the ring.
+ */
+ring_t *ring_clone(ring_t *ring, pde_t *pdt);
+/* frees the ring, the mapping in the process PDT is left to pdt_delete */
+void ring_delete(ring_t *ring);
+
+/* Runs at most to_submit of the queued submissions, stops early if the
+ * completion queue is full.
+ *
+ * @return The number of submissions consumed
+ */
+uint32_t ring_submit(ring_t *ring, uint32_t to_submit, ring_exec_t exec);
+
+#endif /* RING_H */
@@ -0,0 +1,183 @@
+#include "schedstat.h"
+#include "scheduler.h"
+#include "stdio.h"
+#include "common.h"
+
+struct schedstat_buf {
+    char *str;
+    size_t size;
+    size_t len;
+};
+typedef struct schedstat_buf schedstat_buf_t;
+
+/* the number of processes /dev/schedstat shows */
+#define SCHEDSTAT_MAX_PIDS 64
+
+static schedstat_hist_t global_wait;
+static schedstat_hist_t global_slice;
+static vnodeops_t vnodeops;
+
+static uint32_t bucket_for_cycles(uint64_t cycles)
+{
+    uint32_t bucket = 0;
+    uint32_t low = (uint32_t) cycles;
+
+    if ((cycles >> 32) != 0) {
+        return SCHEDSTAT_NUM_BUCKETS - 1;
+    }
+
+    while (low >>= 1) {
+        ++bucket;
+    }
+
+    return bucket;
+}
+
+static void record(schedstat_hist_t *local, schedstat_hist_t *global,
+                   uint64_t cycles)
+{
+    uint32_t bucket = bucket_for_cycles(cycles);
+    local->buckets[bucket]++;
+    global->buckets[bucket]++;
+}
+
+void schedstat_enqueued(schedstat_t *stat, uint64_t now)
+{
+    stat->runnable_since = now;
+}
+
+void schedstat_dispatched(schedstat_t *stat, uint64_t now)
+{
+    if (stat->runnable_since != 0) {
+        record(&stat->wait, &global_wait, now - stat->runnable_since);
+        stat->runnable_since = 0;
+    }
+    stat->slice_start = now;
+}
+
+void schedstat_descheduled(schedstat_t *stat, uint64_t now)
+{
+    if (stat->slice_start != 0) {
+        record(&stat->slice, &global_slice, now - stat->slice_start);
+        stat->slice_start = 0;
+    }
+}
+
+/* Formats a histogram as "<name> <bucket>:<count> ...\n", only the non-empty
+ * buckets are written.
+ */
+static void format_hist(schedstat_buf_t *b, char *name,
+                        schedstat_hist_t const *hist)
+{
+    uint32_t i;
+
+    b->len += snprintf(b->str + b->len, b->size - b->len, "%s", name);
+    for (i = 0; i < SCHEDSTAT_NUM_BUCKETS; ++i) {
+        if (hist->buckets[i] != 0) {
+            b->len += snprintf(b->str + b->len, b->size - b->len,
+                               " %u:%u", i, hist->buckets[i]);
+        }
+    }
+    b->len += snprintf(b->str + b->len, b->size - b->len, "\n");
+}
+
+static void format_process(schedstat_buf_t *b, uint32_t pid,
+                           schedstat_t const *stat)
+{
+    b->len += snprintf(b->str + b->len, b->size - b->len, "%u ", pid);
+    format_hist(b, "wait", &stat->wait);
+    b->len += snprintf(b->str + b->len, b->size - b->len, "%u ", pid);
+    format_hist(b, "slice", &stat->slice);
+}
+
+static int schedstat_open(vnode_t *n)
+{
+    UNUSED_ARGUMENT(n);
+
+    return 0;
+}
+
+static int schedstat_lookup(vnode_t *n, char const *p, vnode_t *o)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(p);
+    UNUSED_ARGUMENT(o);
+
+    return -1;
+}
+
+/* The output has one line per histogram, all histograms are in log2 of
+ * cycles:
+ *
+ *     # pid hist log2(cycles):count ...
+ *     all wait 12:40 13:2
+ *     all slice 24:40
+ *     1 wait 12:20
+ *     ...
+ *
+ * The statistics are formatted anew by every read and must be read in one
+ * go: the output is cut short at count bytes and any offset past the start
+ * of the file reads as the end of it. At most SCHEDSTAT_MAX_PIDS processes
+ * are shown.
+ */
+static int schedstat_read(vnode_t *n, void *buf, size_t count,
+                          uint32_t offset)
+{
+    UNUSED_ARGUMENT(n);
+
+    uint32_t pids[SCHEDSTAT_MAX_PIDS], i, num_pids;
+    schedstat_t stat;
+    schedstat_buf_t b = { buf, count, 0 };
+    if (count == 0 || offset != 0) {
+        return 0;
+    }
+
+    b.len += snprintf(b.str, b.size, "# pid hist log2(cycles):count ...\n");
+    format_hist(&b, "all wait", &global_wait);
+    format_hist(&b, "all slice", &global_slice);
+
+    /* each process is copied under the scheduler's lock, buf is only
+     * written without it */
+    num_pids = scheduler_get_pids(pids, SCHEDSTAT_MAX_PIDS);
+    for (i = 0; i < num_pids; ++i) {
+        if (scheduler_get_schedstat(pids[i], &stat) == 0) {
+            format_process(&b, pids[i], &stat);
+        }
+    }
+
+    return b.len;
+}
+
+static int schedstat_write(vnode_t *n, char const *buf, size_t count)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(buf);
+    UNUSED_ARGUMENT(count);
+
+    return -1;
+}
+
+static int schedstat_getattr(vnode_t *n, vattr_t *attr)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(attr);
+
+    return -1;
+}
+
+void schedstat_init(void)
+{
+    vnodeops.vn_open = &schedstat_open;
+    vnodeops.vn_lookup = &schedstat_lookup;
+    vnodeops.vn_read = &schedstat_read;
+    vnodeops.vn_write = &schedstat_write;
+    vnodeops.vn_getattr = &schedstat_getattr;
+}
+
+int schedstat_get_vnode(vnode_t *out)
+{
+    out->v_op = &vnodeops;
+    out->v_data = 0;
+
+    return 0;
+}
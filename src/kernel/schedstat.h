@@ -0,0 +1,34 @@
+#ifndef SCHEDSTAT_H
+#define SCHEDSTAT_H
+
+#include "stdint.h"
+#include "vnode.h"
+
+/* Bucket i counts the samples in [2^i, 2^(i+1)) cycles, the last bucket also
+ * counts all the samples that are even larger.
+ */
+#define SCHEDSTAT_NUM_BUCKETS 32
+
+struct schedstat_hist {
+    uint32_t buckets[SCHEDSTAT_NUM_BUCKETS];
+};
+typedef struct schedstat_hist schedstat_hist_t;
+
+struct schedstat {
+    uint64_t runnable_since;    /* TSC when put in the run queue, 0 = not */
+    uint64_t slice_start;       /* TSC when given the CPU, 0 = not running */
+    schedstat_hist_t wait;      /* run queue wait, i.e. wakeup-to-run */
+    schedstat_hist_t slice;     /* length of the time slices */
+};
+typedef struct schedstat schedstat_t;
+
+void schedstat_init(void);
+
+/* Called by the scheduler with the current TSC as now */
+void schedstat_enqueued(schedstat_t *stat, uint64_t now);
+void schedstat_dispatched(schedstat_t *stat, uint64_t now);
+void schedstat_descheduled(schedstat_t *stat, uint64_t now);
+
+int schedstat_get_vnode(vnode_t *out);
+
+#endif /* SCHEDSTAT_H */
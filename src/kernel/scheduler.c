@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SCHED
+
 #include "scheduler.h"
 #include "stddef.h"
 #include "tss.h"
@@ -5,56 +7,213 @@
 #include "constants.h"
 #include "log.h"
 #include "kmalloc.h"
-#include "math.h"
 #include "pit.h"
 #include "interrupt.h"
 #include "pic.h"
 #include "common.h"
+#include "tsc.h"
+#include "fpu.h"
+#include "smp.h"
+#include "apic.h"
+#include "spinlock.h"
+#include "sysenter.h"
+#include "kdata.h"
 
 #define SCHEDULER_PIT_INTERVAL 2 /* in ms */
 #define SCHEDULER_TIME_SLICE   (5 * SCHEDULER_PIT_INTERVAL) /* in ms */
 
-uint32_t ms = 0;
+#define SCHEDULER_NUM_RT_PRIOS  32
+#define SCHEDULER_NICE_MIN      -20
+#define SCHEDULER_NICE_MAX      19
+/* the share of the CPU EDF processes may reserve, in per mille */
+#define SCHEDULER_EDF_MAX_UTIL  950
 
-struct ps_list_ele {
-    struct ps_list_ele *next;
-    ps_t *ps;
-};
-typedef struct ps_list_ele ps_list_ele_t;
+#define PID_MAX         1024 /* pids are in the range [1, PID_MAX) */
+#define PID_HASH_SIZE   64
+#define PID_HASH(pid)   ((pid) & (PID_HASH_SIZE - 1))
 
 struct ps_list {
-    ps_list_ele_t *start;
-    ps_list_ele_t *end;
+    ps_t *start;
+    ps_t *end;
 };
 typedef struct ps_list ps_list_t;
 
-static ps_list_t runnable_pss = { NULL, NULL };
-static ps_list_t zombie_pss = { NULL, NULL };
+/* The runnable processes of one CPU, one queue per class. A process stays
+ * in its queue while it is running.
+ */
+struct run_queue {
+    ps_list_t edf_pss;
+    ps_list_t rt_pss[SCHEDULER_NUM_RT_PRIOS];
+    uint32_t rt_bitmap; /* bit i is set if rt_pss[i] is non-empty */
+    ps_list_t normal_pss;
+    uint32_t num_runnable;
+
+    /* the process that was last given the CPU */
+    ps_t *current;
+    /* the process whose kernel stack the CPU is leaving, it must not run
+     * anywhere else until the CPU is on its own stack */
+    ps_t *prev;
+    /* set by the tick when the current process should be switched out */
+    uint32_t need_resched;
+};
+typedef struct run_queue run_queue_t;
+
+static run_queue_t run_queues[SMP_MAX_CPUS];
+
+/* time since the scheduler was started, in ms */
+static uint32_t uptime = 0;
+/* the sum of budget/period of all EDF processes, in per mille */
+static uint32_t edf_util = 0;
+
+/* one bit per pid, a set bit means that the pid is in use */
+static uint32_t pid_bitmap[PID_MAX / 32];
+static uint32_t last_pid = 0;
+static ps_t *pid_table[PID_HASH_SIZE];
+
+/* protects the run queues, the pids and the links between the processes */
+static spinlock_t sched_lock = SPINLOCK_INIT("scheduler");
 
 /* defined in scheduler_asm.s */
 void run_process_in_user_mode(registers_t *registers);
 void run_process_in_kernel_mode(registers_t *registers);
 
-static uint32_t max_id_in_ps_list(ps_list_t *pss)
+static int is_pid_used(uint32_t pid)
+{
+    return pid_bitmap[pid / 32] & (0x01 << (pid % 32));
+}
+
+static void toggle_pid(uint32_t pid)
+{
+    pid_bitmap[pid / 32] ^= (0x01 << (pid % 32));
+}
+
+/* Allocates a pid, starting the search after the last allocated pid and
+ * wrapping around, so that pids aren't reused sooner than necessary.
+ *
+ * @return The allocated pid, or 0 if all pids are in use
+ */
+uint32_t scheduler_next_pid(void)
 {
-    uint32_t max = 0;
-    ps_list_ele_t *p = pss->start;
-    while (p != NULL) {
-        if (p->ps != NULL && p->ps->id >= max) {
-            max = p->ps->id;
+    uint32_t i, pid, flags;
+
+    flags = spin_lock_irqsave(&sched_lock);
+    pid = last_pid;
+    for (i = 1; i < PID_MAX; ++i) {
+        pid = pid + 1 == PID_MAX ? 1 : pid + 1;
+        if (pid % 32 == 0 && pid_bitmap[pid / 32] == 0xFFFFFFFF) {
+            /* skip a full word of used pids */
+            i += 31;
+            pid += 31;
+            continue;
+        }
+        if (!is_pid_used(pid)) {
+            toggle_pid(pid);
+            last_pid = pid;
+            spin_unlock_irqrestore(&sched_lock, flags);
+            return pid;
         }
-        p = p->next;
     }
+    spin_unlock_irqrestore(&sched_lock, flags);
 
-    return max;
+    log_error("scheduler_next_pid", "All pids are in use\n");
+    return 0;
 }
 
-uint32_t scheduler_next_pid(void)
+static void release_pid(uint32_t pid)
+{
+    if (pid != 0 && pid < PID_MAX && is_pid_used(pid)) {
+        toggle_pid(pid);
+    }
+}
+
+void scheduler_release_pid(uint32_t pid)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    release_pid(pid);
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+static ps_t *find_process(uint32_t pid)
+{
+    ps_t *ps;
+    for (ps = pid_table[PID_HASH(pid)]; ps != NULL; ps = ps->pid_next) {
+        if (ps->id == pid) {
+            return ps;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t scheduler_get_pids(uint32_t *pids, uint32_t max)
+{
+    uint32_t i, n = 0, flags;
+    ps_t *ps;
+
+    flags = spin_lock_irqsave(&sched_lock);
+    for (i = 0; i < PID_HASH_SIZE && n < max; ++i) {
+        for (ps = pid_table[i]; ps != NULL && n < max; ps = ps->pid_next) {
+            pids[n++] = ps->id;
+        }
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    return n;
+}
+
+static void pid_table_insert(ps_t *ps)
+{
+    uint32_t idx = PID_HASH(ps->id);
+    ps->pid_next = pid_table[idx];
+    pid_table[idx] = ps;
+}
+
+static void pid_table_remove(ps_t *ps)
+{
+    ps_t **p;
+    for (p = &pid_table[PID_HASH(ps->id)]; *p != NULL; p = &(*p)->pid_next) {
+        if (*p == ps) {
+            *p = ps->pid_next;
+            ps->pid_next = NULL;
+            return;
+        }
+    }
+}
+
+static void sibling_list_add(ps_t **head, ps_t *ps)
 {
-    uint32_t pid_runnable = max_id_in_ps_list(&runnable_pss);
-    uint32_t pid_zombie = max_id_in_ps_list(&zombie_pss);
+    ps->sibling_prev = NULL;
+    ps->sibling_next = *head;
+    if (*head != NULL) {
+        (*head)->sibling_prev = ps;
+    }
+    *head = ps;
+}
+
+static void sibling_list_remove(ps_t **head, ps_t *ps)
+{
+    if (ps->sibling_prev == NULL) {
+        *head = ps->sibling_next;
+    } else {
+        ps->sibling_prev->sibling_next = ps->sibling_next;
+    }
+
+    if (ps->sibling_next != NULL) {
+        ps->sibling_next->sibling_prev = ps->sibling_prev;
+    }
 
-    return maxu(pid_runnable, pid_zombie) + 1;
+    ps->sibling_next = NULL;
+    ps->sibling_prev = NULL;
+}
+
+/* Frees a process that has already released its resources, along with its
+ * pid.
+ */
+static void scheduler_free_process(ps_t *ps)
+{
+    pid_table_remove(ps);
+    release_pid(ps->id);
+    kfree(ps);
 }
 
 static void scheduler_copy_common_registers(registers_t *r,
@@ -90,202 +249,815 @@ static void scheduler_update_kernel_registers(ps_t *ps, cpu_state_t const *cpu,
     ps->current.ss = SEGSEL_KERNEL_DS;
 }
 
+static run_queue_t *this_run_queue(void)
+{
+    return &run_queues[smp_cpu_id()];
+}
 
-static void scheduler_schedule_on_intterupt(cpu_state_t const *cpu,
-                                            stack_state_t const *stack)
+static ps_list_t *scheduler_queue_for(ps_t *ps)
+{
+    run_queue_t *rq = &run_queues[ps->cpu];
+
+    switch (ps->sched.policy) {
+        case SCHED_EDF:
+            return &rq->edf_pss;
+        case SCHED_RT:
+            return &rq->rt_pss[ps->sched.priority];
+        default:
+            return &rq->normal_pss;
+    }
+}
+
+static void scheduler_enqueue(ps_t *ps)
+{
+    ps_list_t *pss = scheduler_queue_for(ps);
+
+    ps->run_next = NULL;
+    ps->run_prev = pss->end;
+
+    if (pss->start == NULL) {
+        pss->start = ps;
+    } else {
+        pss->end->run_next = ps;
+    }
+
+    pss->end = ps;
+
+    if (ps->sched.policy == SCHED_RT) {
+        run_queues[ps->cpu].rt_bitmap |= 0x01 << ps->sched.priority;
+    }
+    run_queues[ps->cpu].num_runnable++;
+}
+
+static void scheduler_dequeue(ps_t *ps)
+{
+    ps_list_t *pss = scheduler_queue_for(ps);
+
+    if (ps->run_prev == NULL) {
+        pss->start = ps->run_next;
+    } else {
+        ps->run_prev->run_next = ps->run_next;
+    }
+
+    if (ps->run_next == NULL) {
+        pss->end = ps->run_prev;
+    } else {
+        ps->run_next->run_prev = ps->run_prev;
+    }
+
+    ps->run_next = NULL;
+    ps->run_prev = NULL;
+
+    if (ps->sched.policy == SCHED_RT && pss->start == NULL) {
+        run_queues[ps->cpu].rt_bitmap &= ~(0x01 << ps->sched.priority);
+    }
+    run_queues[ps->cpu].num_runnable--;
+}
+
+static uint32_t highest_bit(uint32_t n)
+{
+    uint32_t bit = 0;
+    while (n >>= 1) {
+        ++bit;
+    }
+
+    return bit;
+}
+
+/* Picks the process that should run: the EDF process with the earliest
+ * deadline that has budget left, then the RT process with the highest
+ * priority and last the first process in the normal queue. If only throttled
+ * EDF processes are left, one of them is picked rather than idling.
+ */
+static ps_t *scheduler_pick_next(run_queue_t *rq)
+{
+    ps_t *ps, *best = NULL;
+
+    for (ps = rq->edf_pss.start; ps != NULL; ps = ps->run_next) {
+        if (ps->budget_left > 0 &&
+            (best == NULL || ps->deadline < best->deadline)) {
+            best = ps;
+        }
+    }
+    if (best != NULL) {
+        return best;
+    }
+
+    if (rq->rt_bitmap != 0) {
+        return rq->rt_pss[highest_bit(rq->rt_bitmap)].start;
+    }
+
+    if (rq->normal_pss.start != NULL) {
+        return rq->normal_pss.start;
+    }
+
+    return rq->edf_pss.start;
+}
+
+static ps_t *scheduler_find_stealable(ps_list_t *pss, run_queue_t *victim)
+{
+    ps_t *ps;
+
+    /* take from the end of the queue, it has waited the shortest time */
+    for (ps = pss->end; ps != NULL; ps = ps->run_prev) {
+        if (ps != victim->current && ps != victim->prev &&
+            !fpu_is_loaded_elsewhere(&ps->fpu)) {
+            return ps;
+        }
+    }
+
+    return NULL;
+}
+
+/* Moves a process from the busiest CPU to the given (idle) CPU. EDF
+ * processes are never moved, since their reservation was admitted for the
+ * CPU they run on.
+ */
+static ps_t *scheduler_steal(run_queue_t *rq)
+{
+    uint32_t cpu, prio, self = rq - run_queues;
+    run_queue_t *victim = NULL;
+    ps_t *ps = NULL;
+
+    for (cpu = 0; cpu < smp_num_cpus(); ++cpu) {
+        if (cpu != self && run_queues[cpu].num_runnable > 1 &&
+            (victim == NULL ||
+             run_queues[cpu].num_runnable > victim->num_runnable)) {
+            victim = &run_queues[cpu];
+        }
+    }
+    if (victim == NULL) {
+        return NULL;
+    }
+
+    for (prio = SCHEDULER_NUM_RT_PRIOS; ps == NULL && prio > 0; --prio) {
+        ps = scheduler_find_stealable(&victim->rt_pss[prio - 1], victim);
+    }
+    if (ps == NULL) {
+        ps = scheduler_find_stealable(&victim->normal_pss, victim);
+    }
+    if (ps == NULL) {
+        return NULL;
+    }
+
+    scheduler_dequeue(ps);
+    ps->cpu = self;
+    scheduler_enqueue(ps);
+
+    return ps;
+}
+
+/* The CPU placement of a new process, the one with the fewest runnable */
+static uint32_t scheduler_least_loaded_cpu(void)
+{
+    uint32_t cpu, best = 0;
+    for (cpu = 1; cpu < smp_num_cpus(); ++cpu) {
+        if (run_queues[cpu].num_runnable < run_queues[best].num_runnable) {
+            best = cpu;
+        }
+    }
+
+    return best;
+}
+
+static uint32_t scheduler_time_slice(ps_t *ps)
+{
+    int slice;
+
+    switch (ps->sched.policy) {
+        case SCHED_EDF:
+            return ps->budget_left;
+        case SCHED_RT:
+            return SCHEDULER_TIME_SLICE;
+        default:
+            /* nice -20 gives twice the default slice, nice 19 the minimum */
+            slice = SCHEDULER_TIME_SLICE * (20 - ps->sched.priority) / 20;
+            return slice < SCHEDULER_PIT_INTERVAL ? SCHEDULER_PIT_INTERVAL
+                                                  : (uint32_t) slice;
+    }
+}
+
+/* Runs on the CPU's own stack, so the kernel stack of the previous process
+ * is free to be used by another CPU.
+ */
+static void scheduler_run_continuation(uint32_t data)
+{
+    ps_t *ps = (ps_t *) data;
+    run_queue_t *rq = this_run_queue();
+
+    spin_lock(&sched_lock);
+    rq->prev = NULL;
+    spin_unlock(&sched_lock);
+
+    if (ps == NULL) {
+        /* nothing to run on this CPU, wait for the next tick. The tick
+         * abandons this stack frame when it finds a process to run. */
+        pdt_load_kernel_pdt();
+        while (1) {
+            smp_halt();
+        }
+    }
+
+    tss_set_kernel_stack(SEGSEL_KERNEL_DS, ps->kernel_stack_start_vaddr);
+    sysenter_set_kernel_stack(ps->kernel_stack_start_vaddr);
+    if (ps->pdt == NULL) {
+        /* kernel threads only use the kernel's memory */
+        pdt_load_kernel_pdt();
+    } else {
+        pdt_load_process_pdt(ps->pdt, ps->pdt_paddr);
+    }
+    fpu_switch(&ps->fpu);
+
+    if (ps->current.cs == SEGSEL_KERNEL_CS) {
+        run_process_in_kernel_mode(&ps->current);
+    } else {
+        run_process_in_user_mode(&ps->current);
+    }
+}
+
+/* Gives the CPU to ps, or idles if ps is NULL. Must be called with the lock
+ * held and interrupts disabled, releases the lock and never returns.
+ */
+static void scheduler_switch_to(run_queue_t *rq, ps_t *ps)
+{
+    if (ps != rq->current) {
+        uint64_t now = tsc_read();
+        if (rq->current != NULL) {
+            schedstat_descheduled(&rq->current->stat, now);
+            /* a blocked process starts waiting for the CPU when woken */
+            if (rq->current->state == PROCESS_STATE_RUNNABLE) {
+                schedstat_enqueued(&rq->current->stat, now);
+            }
+        }
+        if (ps != NULL) {
+            schedstat_dispatched(&ps->stat, now);
+        }
+    }
+
+    if (ps != NULL && ps->slice_left == 0) {
+        ps->slice_left = scheduler_time_slice(ps);
+    }
+
+    /* the CPU might still be on the kernel stack of the current process */
+    rq->prev = rq->current;
+    rq->current = ps;
+    spin_unlock(&sched_lock);
+
+    switch_to_kernel_stack(&scheduler_run_continuation, (uint32_t) ps);
+}
+
+/* must be called with the lock held */
+static int scheduler_needs_switch(run_queue_t *rq)
+{
+    return rq->current != NULL && scheduler_pick_next(rq) != rq->current;
+}
+
+/* the current process has used up its time slice or gives up the CPU, move
+ * it to the end of its queue */
+static void scheduler_rotate(run_queue_t *rq)
+{
+    ps_t *current = rq->current;
+    if (current != NULL && current->state == PROCESS_STATE_RUNNABLE) {
+        current->slice_left = 0;
+        scheduler_dequeue(current);
+        scheduler_enqueue(current);
+    }
+}
+
+/* must be called with the lock held, never returns */
+static void scheduler_reschedule(run_queue_t *rq)
+{
+    ps_t *ps = scheduler_pick_next(rq);
+    if (ps == NULL) {
+        ps = scheduler_steal(rq);
+    }
+
+    scheduler_switch_to(rq, ps);
+}
+
+int scheduler_should_preempt(void)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    int res = scheduler_needs_switch(this_run_queue());
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    return res;
+}
+
+void scheduler_preempt(void)
 {
     disable_interrupts();
-    ps_t *ps = scheduler_get_current_process();
+    spin_lock(&sched_lock);
+    scheduler_reschedule(this_run_queue());
+}
+
+void scheduler_schedule(void)
+{
+    run_queue_t *rq;
+
+    disable_interrupts();
+    spin_lock(&sched_lock);
+    rq = this_run_queue();
+    scheduler_rotate(rq);
+    scheduler_reschedule(rq);
+}
+
+void scheduler_handle_need_resched(cpu_state_t const *cpu,
+                                   stack_state_t const *stack)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    run_queue_t *rq = this_run_queue();
+    ps_t *ps = rq->current;
+
+    if (!rq->need_resched) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return;
+    }
+    rq->need_resched = 0;
+
+    if (ps == NULL) {
+        /* the CPU is idle, see if there is something to run now */
+        ps = scheduler_pick_next(rq);
+        if (ps == NULL) {
+            ps = scheduler_steal(rq);
+        }
+        if (ps != NULL) {
+            scheduler_switch_to(rq, ps);
+        }
+    } else if (scheduler_needs_switch(rq)) {
+        ps->rusage.nivcsw++;
+        if (stack->cs == (SEGSEL_USER_SPACE_CS | 0x03)) {
+            scheduler_update_user_registers(ps, cpu, stack);
+        } else {
+            scheduler_update_kernel_registers(ps, cpu, stack);
+        }
+        scheduler_reschedule(rq);
+    } else if (ps->slice_left == 0) {
+        /* rotated, but still the most important process */
+        ps->slice_left = scheduler_time_slice(ps);
+    }
+
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+static uint32_t time_left(uint32_t t)
+{
+    return t > SCHEDULER_PIT_INTERVAL ? t - SCHEDULER_PIT_INTERVAL : 0;
+}
+
+/* Starts a new period for the EDF processes whose deadline has passed */
+static void scheduler_replenish_edf(run_queue_t *rq)
+{
+    ps_t *ps;
+    for (ps = rq->edf_pss.start; ps != NULL; ps = ps->run_next) {
+        if (uptime >= ps->deadline) {
+            ps->deadline += ps->sched.period;
+            if (ps->deadline <= uptime) {
+                /* missed more than one period */
+                ps->deadline = uptime + ps->sched.period;
+            }
+            ps->budget_left = ps->sched.budget;
+        }
+    }
+}
+
+/* The scheduler tick of the calling CPU. The tick only does the accounting,
+ * the switch is done by scheduler_handle_need_resched when the interrupt
+ * handler returns.
+ */
+static void scheduler_tick(stack_state_t const *stack,
+                           void (*acknowledge)(void))
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    run_queue_t *rq = this_run_queue();
+    ps_t *ps = rq->current;
+
+    scheduler_replenish_edf(rq);
+
+    if (ps == NULL) {
+        /* the CPU is idle, there might be something to run or steal now */
+        rq->need_resched = 1;
+        spin_unlock_irqrestore(&sched_lock, flags);
+        acknowledge();
+        return;
+    }
+
+    /* Charge the tick to the mode the current process was interrupted in.
+     * The time is sampled at tick granularity rather than measured at every
+     * switch between user and kernel mode, which would need a TSC read on
+     * every interrupt and syscall entry and on every return to user mode.
+     */
     if (stack->cs == (SEGSEL_USER_SPACE_CS | 0x03)) {
-        scheduler_update_user_registers(ps, cpu, stack);
+        ps->rusage.utime += SCHEDULER_PIT_INTERVAL;
     } else {
-        scheduler_update_kernel_registers(ps, cpu, stack);
+        ps->rusage.stime += SCHEDULER_PIT_INTERVAL;
     }
 
-    pic_acknowledge();
+    if (ps->sched.policy == SCHED_EDF) {
+        ps->budget_left = time_left(ps->budget_left);
+    }
 
-    scheduler_schedule();
+    ps->slice_left = time_left(ps->slice_left);
+
+    if (ps->slice_left == 0) {
+        scheduler_rotate(rq);
+        rq->need_resched = 1;
+    } else if (scheduler_needs_switch(rq)) {
+        rq->need_resched = 1;
+    }
+
+    spin_unlock_irqrestore(&sched_lock, flags);
+    acknowledge();
 }
 
 static void scheduler_handle_pit_interrupt(cpu_state_t cpu, idt_info_t info,
                                            stack_state_t stack)
 {
+    UNUSED_ARGUMENT(cpu);
     UNUSED_ARGUMENT(info);
-    ms += SCHEDULER_PIT_INTERVAL;
+    uptime += SCHEDULER_PIT_INTERVAL;
+    kdata_set_uptime(uptime);
 
-    if (ms >= SCHEDULER_TIME_SLICE) {
-        ms = 0;
-        scheduler_schedule_on_intterupt(&cpu, &stack);
-    } else {
-        pic_acknowledge();
+    /* the PIT only interrupts the BSP, pass the tick on to the APs */
+    if (smp_num_cpus() > 1) {
+        apic_send_to_others(APIC_TICK_INT_IDX);
     }
+
+    scheduler_tick(&stack, pic_acknowledge);
+}
+
+static void scheduler_handle_apic_tick(cpu_state_t cpu, idt_info_t info,
+                                       stack_state_t stack)
+{
+    UNUSED_ARGUMENT(cpu);
+    UNUSED_ARGUMENT(info);
+    scheduler_tick(&stack, apic_eoi);
 }
 
 int scheduler_init(void)
 {
     pit_set_interval(SCHEDULER_PIT_INTERVAL);
+    if (register_interrupt_handler(APIC_TICK_INT_IDX,
+                                   &scheduler_handle_apic_tick)) {
+        return 1;
+    }
     return register_interrupt_handler(PIT_INT_IDX,
                                       &scheduler_handle_pit_interrupt);
 }
 
+void scheduler_prepare_wait(wait_queue_t *wq)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    ps_t *ps = this_run_queue()->current;
+
+    if (ps != NULL && ps->state == PROCESS_STATE_RUNNABLE) {
+        /* the CPU keeps running ps until it calls the scheduler */
+        scheduler_dequeue(ps);
+        ps->state = PROCESS_STATE_BLOCKED;
+        ps->wait_next = wq->start;
+        wq->start = ps;
+    }
+
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+void scheduler_wake_all(wait_queue_t *wq)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    ps_t *ps, *next;
+    uint64_t now = tsc_read();
+
+    for (ps = wq->start; ps != NULL; ps = next) {
+        next = ps->wait_next;
+        ps->wait_next = NULL;
+        ps->state = PROCESS_STATE_RUNNABLE;
+        scheduler_enqueue(ps);
+        schedstat_enqueued(&ps->stat, now);
+    }
+    wq->start = NULL;
+
+    spin_unlock_irqrestore(&sched_lock, flags);
+}
+
+uint32_t scheduler_uptime(void)
+{
+    return uptime;
+}
+
 ps_t *scheduler_get_current_process()
 {
-    return runnable_pss.start == NULL ? NULL : runnable_pss.start->ps;
+    /* the caller can't be moved to another CPU with interrupts disabled */
+    uint32_t flags = interrupts_save_and_disable();
+    ps_t *ps = this_run_queue()->current;
+    interrupts_restore(flags);
+
+    return ps;
 }
 
-static int scheduler_add_process(ps_list_t *pss, ps_t *ps)
+/* pid 0 is the calling process, called with the scheduler lock held */
+static ps_t *find_process_or_current(uint32_t pid)
 {
-    ps_list_ele_t *ele = kmalloc(sizeof(ps_list_ele_t));
-    if (ele == NULL) {
-        log_error("scheduler_add_process",
-                  "Couldn't allocate memory for ps_list_t struct\n");
+    return pid == 0 ? this_run_queue()->current : find_process(pid);
+}
+
+int scheduler_get_rusage(uint32_t pid, rusage_t *out)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    ps_t *ps = find_process_or_current(pid);
+    if (ps == NULL) {
+        spin_unlock_irqrestore(&sched_lock, flags);
         return -1;
     }
 
-    ele->ps = ps;
-    ele->next = NULL;
+    *out = ps->rusage;
+    spin_unlock_irqrestore(&sched_lock, flags);
 
-    if (pss->start == NULL) {
-        pss->start = ele;
-    } else {
-        pss->end->next = ele;
+    return 0;
+}
+
+int scheduler_get_schedstat(uint32_t pid, schedstat_t *out)
+{
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    ps_t *ps = find_process_or_current(pid);
+    if (ps == NULL) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
     }
 
-    pss->end = ele;
+    *out = ps->stat;
+    spin_unlock_irqrestore(&sched_lock, flags);
 
     return 0;
 }
 
+/* Registers a newly created process with the scheduler and links it to its
+ * parent (if the parent is still alive). A forked process inherits the
+ * scheduling class of its parent, except for EDF since the parent's
+ * reservation can't be shared.
+ */
 int scheduler_add_runnable_process(ps_t *ps)
 {
-    return scheduler_add_process(&runnable_pss, ps);
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+
+    if (ps->state == PROCESS_STATE_NEW) {
+        pid_table_insert(ps);
+
+        ps->parent = find_process(ps->parent_id);
+        if (ps->parent != NULL) {
+            sibling_list_add(&ps->parent->children, ps);
+            ps->parent->num_children++;
+
+            if (ps->parent->sched.policy != SCHED_EDF) {
+                ps->sched = ps->parent->sched;
+            }
+        } else {
+            process_set_parent_id(ps, 0);
+        }
+
+        ps->cpu = scheduler_least_loaded_cpu();
+    }
+
+    ps->state = PROCESS_STATE_RUNNABLE;
+    scheduler_enqueue(ps);
+    schedstat_enqueued(&ps->stat, tsc_read());
+
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
 }
 
-static int scheduler_remove_process(ps_list_t *pss, uint32_t pid,
-                                    uint32_t should_delete)
+static uint32_t edf_utilization(sched_param_t const *param)
 {
-    ps_list_ele_t *current = pss->start;
-    ps_list_ele_t *prev = NULL;
-    while (current != NULL) {
-        if (current->ps != NULL && current->ps->id == pid) {
-            if (prev == NULL) {
-                pss->start= current->next;
-            } else {
-                prev->next = current->next;
-            }
+    return param->budget * 1000 / param->period;
+}
 
-            if (pss->end == current) {
-                pss->end = prev;
-                prev->next = NULL;
-            }
+int scheduler_set_param_pid(uint32_t pid, sched_param_t const *param)
+{
+    ps_t *ps;
 
-            if (should_delete) {
-                process_delete_resources(current->ps);
-                kfree(current->ps);
+    switch (param->policy) {
+        case SCHED_NORMAL:
+            if (param->priority < SCHEDULER_NICE_MIN ||
+                param->priority > SCHEDULER_NICE_MAX) {
+                return -1;
             }
+            break;
+        case SCHED_RT:
+            if (param->priority < 0 ||
+                param->priority >= SCHEDULER_NUM_RT_PRIOS) {
+                return -1;
+            }
+            break;
+        case SCHED_EDF:
+            if (param->period == 0 || param->budget == 0 ||
+                param->budget > param->period) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+    }
 
-            kfree(current);
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+    ps = find_process_or_current(pid);
+    if (ps == NULL || (ps->state != PROCESS_STATE_RUNNABLE &&
+                       ps->state != PROCESS_STATE_BLOCKED)) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
 
-            return 0;
+    /* admission control for EDF, the old reservation is given back first */
+    uint32_t util = edf_util;
+    if (ps->sched.policy == SCHED_EDF) {
+        util -= edf_utilization(&ps->sched);
+    }
+    if (param->policy == SCHED_EDF) {
+        util += edf_utilization(param);
+        if (util > SCHEDULER_EDF_MAX_UTIL) {
+            log_info("scheduler_set_param",
+                     "EDF reservation rejected. pid: %u, util: %u\n",
+                     ps->id, util);
+            spin_unlock_irqrestore(&sched_lock, flags);
+            return -1;
         }
-        prev = current;
-        current = current->next;
+    }
+    edf_util = util;
+
+    if (ps->state == PROCESS_STATE_RUNNABLE) {
+        scheduler_dequeue(ps);
+    }
+
+    ps->sched = *param;
+    ps->slice_left = 0;
+    if (param->policy == SCHED_EDF) {
+        ps->deadline = uptime + param->period;
+        ps->budget_left = param->budget;
+    }
+
+    if (ps->state == PROCESS_STATE_RUNNABLE) {
+        scheduler_enqueue(ps);
     }
 
-    return -1;
+    spin_unlock_irqrestore(&sched_lock, flags);
+    return 0;
 }
 
 void scheduler_terminate_process(ps_t *ps)
 {
-    scheduler_remove_process(&runnable_pss, ps->id, 0);
+    ps_t *child, *next;
+    uint32_t flags = spin_lock_irqsave(&sched_lock);
+
+    if (ps == run_queues[ps->cpu].current) {
+        schedstat_descheduled(&ps->stat, tsc_read());
+        run_queues[ps->cpu].current = NULL;
+    }
+
+    if (ps->sched.policy == SCHED_EDF) {
+        edf_util -= edf_utilization(&ps->sched);
+    }
+
+    scheduler_dequeue(ps);
+    ps->state = PROCESS_STATE_ZOMBIE;
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    /* the parent can't reap the ps until it is on the zombie list. The ps
+     * is the current one, so leave its PDT before another CPU can reuse
+     * the page frames of the page tables. */
+    fpu_release(&ps->fpu);
+    pdt_load_kernel_pdt();
     process_delete_resources(ps);
-    scheduler_add_process(&zombie_pss, ps);
+
+    flags = spin_lock_irqsave(&sched_lock);
+
+    /* nobody can wait for the zombie children anymore */
+    for (child = ps->zombies; child != NULL; child = next) {
+        next = child->sibling_next;
+        scheduler_free_process(child);
+    }
+    ps->zombies = NULL;
+
+    /* orphan the live children */
+    for (child = ps->children; child != NULL; child = child->sibling_next) {
+        child->parent = NULL;
+        process_set_parent_id(child, 0);
+    }
+    ps->children = NULL;
+    ps->num_children = 0;
+
+    if (ps->parent == NULL) {
+        scheduler_free_process(ps);
+    } else {
+        sibling_list_remove(&ps->parent->children, ps);
+        sibling_list_add(&ps->parent->zombies, ps);
+    }
+    spin_unlock_irqrestore(&sched_lock, flags);
 }
 
-int scheduler_has_any_child_terminated(ps_t *parent)
+static void continue_exit(uint32_t data)
 {
-    ps_list_ele_t *e = zombie_pss.start;
-    while (e != NULL) {
-        if (e->ps->parent_id == parent->id) {
-            return 1;
-        }
-        e = e->next;
-    }
+    UNUSED_ARGUMENT(data);
+    ps_t *ps = scheduler_get_current_process();
 
-    return 0;
+    scheduler_terminate_process(ps);
+
+    scheduler_schedule();
+    /* we should never get here */
 }
 
-static int scheduler_count_children_in_list(ps_list_t *pss, uint32_t pid)
+void scheduler_exit(void)
 {
-    int num = 0;
-    ps_list_ele_t *e = pss->start;
-    while (e != NULL) {
-        if (e->ps->parent_id == pid) {
-            ++num;
-        }
-        e = e->next;
-    }
+    /* the kernel stack is deleted along with the process, so leave it first */
+    switch_to_kernel_stack(continue_exit, 0);
+}
 
-    return num;
+int scheduler_has_any_child_terminated(ps_t *parent)
+{
+    return parent->zombies != NULL;
 }
 
-int scheduler_num_children(uint32_t pid)
+uint32_t scheduler_reap_child(ps_t *parent)
 {
-    int num_zombies = scheduler_count_children_in_list(&zombie_pss, pid);
-    int num_running = scheduler_count_children_in_list(&runnable_pss, pid);
+    uint32_t pid, flags;
+    ps_t *zombie;
 
-    return num_zombies + num_running;
+    flags = spin_lock_irqsave(&sched_lock);
+    zombie = parent->zombies;
+    if (zombie == NULL) {
+        spin_unlock_irqrestore(&sched_lock, flags);
+        return 0;
+    }
+
+    sibling_list_remove(&parent->zombies, zombie);
+    parent->num_children--;
+
+    pid = zombie->id;
+    scheduler_free_process(zombie);
+    spin_unlock_irqrestore(&sched_lock, flags);
+
+    return pid;
+}
+
+int scheduler_num_children(ps_t *parent)
+{
+    return parent->num_children;
 }
 
 int scheduler_replace_process(ps_t *old, ps_t *new)
 {
-    int error;
+    ps_t *child;
+    uint32_t flags;
 
-    error = scheduler_remove_process(&runnable_pss, old->id, 1);
-    if (error) {
+    if (old->id != new->id) {
         log_error("scheduler_replace_process",
-                  "Couldn't remove old process %u\n", old->id);
+                  "The new process must reuse the pid. old: %u, new: %u\n",
+                  old->id, new->id);
         return -1;
     }
 
-    return scheduler_add_runnable_process(new);
-}
+    flags = spin_lock_irqsave(&sched_lock);
+    if (old == run_queues[old->cpu].current) {
+        run_queues[old->cpu].current = NULL;
+    }
 
-static ps_t *scheduler_get_and_rotate_runnable_process(void)
-{
-    if (runnable_pss.start == NULL || runnable_pss.start->ps == NULL) {
-        log_error("scheduler_get_and_rotate_runnable_process",
-                  "There are no processes to schedule\n");
-        return NULL;
+    scheduler_dequeue(old);
+    fpu_release(&old->fpu);
+    pid_table_remove(old);
+
+    /* the new process takes over all the links of the old process */
+    new->parent = old->parent;
+    process_set_parent_id(new, old->parent_id);
+    if (new->parent != NULL) {
+        sibling_list_remove(&new->parent->children, old);
+        sibling_list_add(&new->parent->children, new);
     }
 
-    ps_list_ele_t *start = runnable_pss.start;
-    if (start->next != NULL) {
-        /* more than one element in the list */
-        /* move current process (head of list) to end of list */
-        runnable_pss.start = start->next;
-        start->next = NULL;
-        runnable_pss.end->next = start;
-        runnable_pss.end = start;
+    new->children = old->children;
+    new->zombies = old->zombies;
+    new->num_children = old->num_children;
+    for (child = new->children; child != NULL; child = child->sibling_next) {
+        child->parent = new;
+    }
+    for (child = new->zombies; child != NULL; child = child->sibling_next) {
+        child->parent = new;
     }
 
-    return runnable_pss.start->ps;
-}
+    /* as well as the scheduling class and the accounting */
+    new->sched = old->sched;
+    new->deadline = old->deadline;
+    new->budget_left = old->budget_left;
+    new->stat = old->stat;
+    new->rusage = old->rusage;
+    new->cpu = old->cpu;
 
-void scheduler_schedule(void)
-{
-    ps_t *ps = scheduler_get_and_rotate_runnable_process();
-    if (ps == NULL) {
-        log_error("scheduler_schedule", "Can't schedule processes\n");
-        return;
-    }
+    pid_table_insert(new);
+    new->state = PROCESS_STATE_RUNNABLE;
+    scheduler_enqueue(new);
+    schedstat_enqueued(&new->stat, tsc_read());
+    spin_unlock_irqrestore(&sched_lock, flags);
 
-    tss_set_kernel_stack(SEGSEL_KERNEL_DS, ps->kernel_stack_start_vaddr);
-    pdt_load_process_pdt(ps->pdt, ps->pdt_paddr);
+    /* same as in scheduler_terminate_process, old is the current ps */
+    pdt_load_kernel_pdt();
+    process_delete_resources(old);
+    kfree(old);
 
-    if (ps->current.cs == SEGSEL_KERNEL_CS) {
-        run_process_in_kernel_mode(&ps->current);
-    } else {
-        run_process_in_user_mode(&ps->current);
-    }
+    return 0;
 }
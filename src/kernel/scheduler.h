@@ -3,20 +3,76 @@
 
 #include "stdint.h"
 #include "process.h"
+#include "interrupt.h"
+
+/* processes that are blocked until something happens, protected by the
+ * scheduler's lock */
+struct wait_queue {
+    ps_t *start;
+};
+typedef struct wait_queue wait_queue_t;
+
+#define WAIT_QUEUE_INIT { 0 }
 
 uint32_t scheduler_next_pid(void);
+void scheduler_release_pid(uint32_t pid);
+/* Copies the resource usage of the process, pid 0 is the calling process.
+ * The copy is made under the scheduler's lock since the process might exit
+ * on another CPU, so out must not be a user mode buffer.
+ */
+int scheduler_get_rusage(uint32_t pid, rusage_t *out);
+/* Same as scheduler_get_rusage, for the run queue statistics */
+int scheduler_get_schedstat(uint32_t pid, schedstat_t *out);
+/* Fills pids with the pids of at most max processes, in no particular order
+ *
+ * @return The number of pids
+ */
+uint32_t scheduler_get_pids(uint32_t *pids, uint32_t max);
 
 int scheduler_init(void);
 
 int scheduler_add_runnable_process(ps_t *ps);
 int scheduler_replace_process(ps_t *old, ps_t *new);
 void scheduler_terminate_process(ps_t *ps);
+/* Terminates the calling process, e.g. on exit or after a fault it can't
+ * continue from. Never returns.
+ */
+void scheduler_exit(void);
 int scheduler_has_any_child_terminated(ps_t *parent);
-int scheduler_num_children(uint32_t pid);
+uint32_t scheduler_reap_child(ps_t *parent);
+int scheduler_num_children(ps_t *parent);
+/* Changes the scheduling parameters of a runnable or blocked process, pid 0
+ * is the calling process. param must not be a user mode buffer.
+ */
+int scheduler_set_param_pid(uint32_t pid, sched_param_t const *param);
 
+/* rotates the current process to the end of its queue, then switches */
 void scheduler_schedule(void);
+/* switches to the most important runnable process without rotating */
+void scheduler_preempt(void);
+int scheduler_should_preempt(void);
 ps_t *scheduler_get_current_process();
+/* the time since the scheduler was started, in ms */
+uint32_t scheduler_uptime(void);
+/* Switches process if the tick has asked for it, called with interrupts
+ * disabled when an interrupt handler returns
+ */
+void scheduler_handle_need_resched(cpu_state_t const *cpu,
+                                   stack_state_t const *stack);
 
+/* Saves the registers in current and gives up the CPU. The caller resumes
+ * from the call with the interrupt flag it had when it made the call.
+ */
 void snapshot_and_schedule(registers_t *current);
 
+/* Blocks the current process in wq. The caller must check its condition
+ * under a lock that the waker also takes, call this before releasing the lock
+ * and then give up the CPU with snapshot_and_schedule. A wake up in between
+ * only makes the process runnable again, so the caller must check its
+ * condition again when it runs.
+ */
+void scheduler_prepare_wait(wait_queue_t *wq);
+/* makes all the processes in wq runnable */
+void scheduler_wake_all(wait_queue_t *wq);
+
 #endif /* SCHEDULER_H */
@@ -69,8 +69,10 @@ run_process_in_kernel_mode:
     iret                            ; iret to return to the process
 
 snapshot_and_schedule:
+    pushf                           ; snapshot eflags before the cli, so the
+                                    ; caller resumes with its own IF
     cli                             ; disable external interrupts
-    mov     eax, [esp+4]            ; load address of registers_t into eax
+    mov     eax, [esp+8]            ; load address of registers_t into eax
 
     ; restore all the registers except eax, since eax holds return value
     mov     DWORD [eax], 0          ; 0 => the function call was succesfull
@@ -82,11 +84,9 @@ snapshot_and_schedule:
     mov     [eax+24], edi
     mov     [eax+28], ss
     mov     [eax+32], esp
-    add     DWORD [eax+32], 4
+    add     DWORD [eax+32], 8       ; skip the eflags and the return address
 
-    ; snapshot eflags
-    pushf
-    pop     DWORD [eax+36]
+    pop     DWORD [eax+36]          ; the eflags pushed above
 
     mov     [eax+40], cs
     mov     ebx, [esp]
@@ -1,9 +1,15 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_DEV
+
 #include "serial.h"
 #include "io.h"
 #include "interrupt.h"
 #include "common.h"
 #include "log.h"
 #include "pic.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include "stddef.h"
+#include "tty.h"
 
 /* ports */
 #define DATA_PORT(port) port
@@ -12,20 +18,202 @@
 #define LINE_CONTROL_PORT(port) port+3
 #define MODEM_CONTROL_PORT(port) port+4
 #define LINE_STATUTS_PORT(port) port+5
+#define MODEM_STATUS_PORT(port) port+6
 #define DLAB_LOW_BYTE_PORT(port) port
 #define DLAB_HIGH_BYTE_PORT(port) port + 1
 
+#define INTERRUPT_ID_PORT(port) port+2
+
 /* constants */
 #define ENABLE_DLAB 0x80
 #define BAUD_RATE_DIVISOR 0x03 /* will give a baud rate of 115200 / 3 = 38400 */
 
+#define SERIAL_FIFO_SIZE 16
+#define SERIAL_RX_BUF_SIZE 1024     /* must be a power of two */
+#define SERIAL_IER_RDA 0x01         /* received data available */
+#define SERIAL_IER_THRE 0x02        /* transmitter holding register empty */
+#define SERIAL_IIR_NONE 0x01        /* no interrupt pending */
+#define SERIAL_IIR_ID_MASK 0x0E
+#define SERIAL_IIR_MODEM 0x00
+#define SERIAL_IIR_THRE 0x02
+#define SERIAL_IIR_LINE 0x06
+#define SERIAL_LSR_DATA_READY 0x01
+
+/* The writers put the bytes in a ring buffer, the THRE interrupt moves them
+ * to the transmit FIFO when the UART has sent the previous ones, so nobody
+ * has to wait for the UART. The received bytes are moved to another ring by
+ * the interrupt handler and handed to the port's tty by a tasklet.
+ */
+struct serial_port {
+    uint16_t com;
+    uint32_t initialized;
+    uint8_t tx_buf[SERIAL_TX_BUF_SIZE];
+    uint32_t tx_head;       /* free running, the next byte to send */
+    uint32_t tx_tail;       /* free running, where the next byte goes */
+    uint32_t tx_active;     /* 1 if the THRE interrupt is enabled */
+    uint32_t tx_overflows;  /* bytes dropped because the ring was full */
+    spinlock_t lock;
+
+    uint8_t rx_buf[SERIAL_RX_BUF_SIZE];
+    uint32_t rx_head;       /* free running, only changed by the tasklet */
+    uint32_t rx_tail;       /* free running, only changed by the handler */
+    uint32_t rx_overflows;
+    tty_t tty;
+};
+typedef struct serial_port serial_port_t;
+
+/* the ttys are set up by serial_init */
+static serial_port_t com1_port = { COM1, 0, { 0 }, 0, 0, 0, 0,
+                                   SPINLOCK_INIT("com1"),
+                                   { 0 }, 0, 0, 0, { 0 } };
+static serial_port_t com2_port = { COM2, 0, { 0 }, 0, 0, 0, 0,
+                                   SPINLOCK_INIT("com2"),
+                                   { 0 }, 0, 0, 0, { 0 } };
+
+static serial_port_t *serial_port(uint16_t com)
+{
+    if (com == COM1) {
+        return &com1_port;
+    } else if (com == COM2) {
+        return &com2_port;
+    }
+    return NULL;
+}
+
+static int is_transmit_fifo_empty(uint16_t com)
+{
+    /* 0x20 = bit 5: 1 if XMIT fifo is empty */
+    return inb(LINE_STATUTS_PORT(com)) & 0x20;
+}
+
+/* Moves up to a FIFO full of bytes from the ring to the UART, must be called
+ * with the lock held and only when the transmit FIFO is empty.
+ */
+static void serial_fill_fifo(serial_port_t *port)
+{
+    uint32_t n = 0;
+    while (port->tx_head != port->tx_tail && n < SERIAL_FIFO_SIZE) {
+        outb(DATA_PORT(port->com),
+             port->tx_buf[port->tx_head % SERIAL_TX_BUF_SIZE]);
+        port->tx_head++;
+        n++;
+    }
+}
+
+static void serial_set_thre_interrupt(serial_port_t *port, uint32_t enable)
+{
+    port->tx_active = enable;
+    outb(INTERRUPT_ENABLE_PORT(port->com),
+         SERIAL_IER_RDA | (enable ? SERIAL_IER_THRE : 0x00));
+}
+
+/* called with the lock held after bytes have been added to the ring */
+static void serial_start_tx(serial_port_t *port)
+{
+    /* the writer might have interrupts disabled for a long time (e.g. while
+     * booting), so it helps out if the UART is idle */
+    if (is_transmit_fifo_empty(port->com)) {
+        serial_fill_fifo(port);
+    }
+
+    if (!port->tx_active && port->tx_head != port->tx_tail) {
+        serial_set_thre_interrupt(port, 1);
+    }
+}
+
+/* called with the lock held */
+static void serial_handle_tx(serial_port_t *port)
+{
+    if (port->tx_head == port->tx_tail) {
+        serial_set_thre_interrupt(port, 0);
+    } else {
+        serial_fill_fifo(port);
+    }
+}
+
+/* called with the lock held, moves the received bytes to the rx ring */
+static void serial_handle_rx(serial_port_t *port)
+{
+    uint8_t b;
+
+    while (inb(LINE_STATUTS_PORT(port->com)) & SERIAL_LSR_DATA_READY) {
+        b = inb(DATA_PORT(port->com));
+        if (port->rx_tail - port->rx_head < SERIAL_RX_BUF_SIZE) {
+            port->rx_buf[port->rx_tail % SERIAL_RX_BUF_SIZE] = b;
+            port->rx_tail++;
+        } else {
+            port->rx_overflows++;
+        }
+    }
+}
+
+/* @return 1 if bytes were received */
+static int serial_handle_interrupt(serial_port_t *port)
+{
+    uint8_t iir;
+    uint32_t rx_tail;
+
+    spin_lock(&port->lock);
+    rx_tail = port->rx_tail;
+    while (!((iir = inb(INTERRUPT_ID_PORT(port->com))) & SERIAL_IIR_NONE)) {
+        switch (iir & SERIAL_IIR_ID_MASK) {
+            case SERIAL_IIR_THRE:
+                serial_handle_tx(port);
+                break;
+            case SERIAL_IIR_LINE:
+                /* reading the status clears the interrupt */
+                inb(LINE_STATUTS_PORT(port->com));
+                break;
+            case SERIAL_IIR_MODEM:
+                inb(MODEM_STATUS_PORT(port->com));
+                break;
+            default:
+                /* received data or a character timeout */
+                serial_handle_rx(port);
+                break;
+        }
+    }
+    rx_tail = port->rx_tail != rx_tail;
+    spin_unlock(&port->lock);
+
+    return rx_tail;
+}
+
+/* hands the received bytes to the tty a batch at a time, without the port's
+ * lock since the tty echoes through the port */
+static void serial_rx_tasklet(uint32_t com)
+{
+    serial_port_t *port = serial_port(com);
+    char batch[SERIAL_FIFO_SIZE];
+    uint32_t flags, i, n;
+
+    do {
+        flags = spin_lock_irqsave(&port->lock);
+        for (n = 0; n < SERIAL_FIFO_SIZE && port->rx_head != port->rx_tail;
+             ++n) {
+            batch[n] = port->rx_buf[port->rx_head % SERIAL_RX_BUF_SIZE];
+            port->rx_head++;
+        }
+        spin_unlock_irqrestore(&port->lock, flags);
+
+        for (i = 0; i < n; ++i) {
+            tty_input(&port->tty, batch[i]);
+        }
+    } while (n == SERIAL_FIFO_SIZE);
+}
+
+static tasklet_t com1_tasklet = TASKLET_INIT(&serial_rx_tasklet, COM1);
+static tasklet_t com2_tasklet = TASKLET_INIT(&serial_rx_tasklet, COM2);
+
 static void serial_handle_interrupt_com1(cpu_state_t state, idt_info_t info,
                           stack_state_t exec)
 {
     UNUSED_ARGUMENT(state);
     UNUSED_ARGUMENT(info);
     UNUSED_ARGUMENT(exec);
-    log_info("serial_handle_interrupt_com1", "data on com1\n");
+    if (serial_handle_interrupt(&com1_port)) {
+        tasklet_schedule(&com1_tasklet);
+    }
     pic_acknowledge();
 }
 
@@ -35,13 +223,21 @@ static void serial_handle_interrupt_com2(cpu_state_t state, idt_info_t info,
     UNUSED_ARGUMENT(state);
     UNUSED_ARGUMENT(info);
     UNUSED_ARGUMENT(exec);
-    log_info("serial_handle_interrupt_com2", "data on com2\n");
+    if (serial_handle_interrupt(&com2_port)) {
+        tasklet_schedule(&com2_tasklet);
+    }
     pic_acknowledge();
 }
 
+static int serial_tty_output(tty_t *tty, char const *buf, size_t len)
+{
+    return serial_write_buf(tty->data, buf, len);
+}
+
 void serial_init(uint16_t com)
 {
     uint8_t config;
+    serial_port_t *port;
     /* disable innterupts */
     outb(INTERRUPT_ENABLE_PORT(com), 0x00);
 
@@ -89,20 +285,71 @@ void serial_init(uint16_t com)
 
     register_interrupt_handler(COM1_INT_IDX, serial_handle_interrupt_com1);
     register_interrupt_handler(COM2_INT_IDX, serial_handle_interrupt_com2);
+
+    port = serial_port(com);
+    if (port != NULL) {
+        port->initialized = 1;
+        /* a terminal on the other end sends \r and erases with \b \b */
+        tty_init(&port->tty, com == COM1 ? "ttyS0" : "ttyS1",
+                 &serial_tty_output, "\b \b", com);
+        serial_set_thre_interrupt(port, 0);
+    }
 }
 
-static int is_transmit_fifo_empty(uint16_t com)
+void serial_write(uint16_t com, uint8_t data)
 {
-    /* 0x20 = bit 5: 1 if XMIT fifo is empty */
-    return inb(LINE_STATUTS_PORT(com)) & 0x20;
+    serial_write_buf(com, (char const *) &data, 1);
 }
 
-void serial_write(uint16_t com, uint8_t data)
+uint32_t serial_write_buf(uint16_t com, char const *buf, uint32_t len)
 {
-    while (!is_transmit_fifo_empty(com)) {
-        /* wait and try again */
+    uint32_t flags, i, free;
+    serial_port_t *port = serial_port(com);
+
+    if (port == NULL || !port->initialized) {
+        /* no ring yet, poll the UART */
+        for (i = 0; i < len; ++i) {
+            while (!is_transmit_fifo_empty(com)) {
+                /* wait and try again */
+            }
+            outb(DATA_PORT(com), buf[i]);
+        }
+        return len;
+    }
+
+    flags = spin_lock_irqsave(&port->lock);
+
+    free = SERIAL_TX_BUF_SIZE - (port->tx_tail - port->tx_head);
+    if (len > free) {
+        port->tx_overflows += len - free;
+        len = free;
+    }
+
+    for (i = 0; i < len; ++i) {
+        port->tx_buf[(port->tx_tail + i) % SERIAL_TX_BUF_SIZE] = buf[i];
     }
-    outb(DATA_PORT(com), data);
+    port->tx_tail += len;
+
+    serial_start_tx(port);
+    spin_unlock_irqrestore(&port->lock, flags);
+
+    return len;
+}
+
+uint32_t serial_tx_free(uint16_t com)
+{
+    serial_port_t *port = serial_port(com);
+    if (port == NULL || !port->initialized) {
+        /* polled, there is always room */
+        return SERIAL_TX_BUF_SIZE;
+    }
+    return SERIAL_TX_BUF_SIZE - (port->tx_tail - port->tx_head);
+}
+
+uint32_t serial_tx_overflows(uint16_t com)
+{
+    serial_port_t *port = serial_port(com);
+    return port == NULL ? 0 : port->tx_overflows;
 }
 
 static int is_receiver_fifo_full(uint16_t com)
@@ -119,3 +366,13 @@ uint8_t serial_read(uint16_t com)
 
     return inb(DATA_PORT(com));
 }
+
+int serial_ttyS0_get_vnode(vnode_t *out)
+{
+    return tty_get_vnode(&com1_port.tty, out);
+}
+
+int serial_ttyS1_get_vnode(vnode_t *out)
+{
+    return tty_get_vnode(&com2_port.tty, out);
+}
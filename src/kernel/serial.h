@@ -2,12 +2,29 @@
 #define SERIAL_H
 
 #include "stdint.h"
+#include "vnode.h"
 
 #define COM1 0x3F8
 #define COM2 0x2F8
 
+#define SERIAL_TX_BUF_SIZE 4096 /* must be a power of two */
+
+/* also sets up the port's tty, /dev/ttyS0 for COM1 and /dev/ttyS1 for COM2 */
 void serial_init(uint16_t com);
+
+/* Writing only copies the bytes to the port's transmit ring, the UART is fed
+ * from its interrupt handler. Before serial_init the UART is polled.
+ */
 void serial_write(uint16_t com, uint8_t data);
+/* @return The number of bytes written, less than len if the ring is full */
+uint32_t serial_write_buf(uint16_t com, char const *buf, uint32_t len);
+/* the number of bytes that fit in the transmit ring right now */
+uint32_t serial_tx_free(uint16_t com);
+/* the number of bytes dropped because the transmit ring was full */
+uint32_t serial_tx_overflows(uint16_t com);
 uint8_t serial_read(uint16_t com);
 
+int serial_ttyS0_get_vnode(vnode_t *out);
+int serial_ttyS1_get_vnode(vnode_t *out);
+
 #endif /* SERIAL_H */
@@ -0,0 +1,305 @@
+#include "smp.h"
+#include "apic.h"
+#include "gdt.h"
+#include "idt.h"
+#include "tss.h"
+#include "fpu.h"
+#include "sysenter.h"
+#include "paging.h"
+#include "kmalloc.h"
+#include "scheduler.h"
+#include "io.h"
+#include "string.h"
+#include "common.h"
+#include "log.h"
+
+/* Information about the MP table was found in the Intel MultiProcessor
+ * Specification, version 1.4
+ */
+
+#define MP_FLOATING_SIGNATURE   0x5F504D5F /* "_MP_" */
+#define MP_CONFIG_SIGNATURE     0x504D4350 /* "PCMP" */
+#define MP_ENTRY_PROCESSOR      0
+#define MP_PROCESSOR_ENTRY_SIZE 20
+#define MP_OTHER_ENTRY_SIZE     8
+#define MP_CPU_ENABLED          0x01
+#define MP_CPU_BSP              0x02
+
+#define BDA_EBDA_SEGMENT        0x40E
+#define BASE_MEMORY_END         0xA0000
+#define BIOS_ROM_START          0xF0000
+#define BIOS_ROM_END            0x100000
+
+#define SMP_AP_START_TIMEOUT    100000 /* in us */
+
+struct mp_floating {
+    uint32_t signature;
+    uint32_t config_paddr;
+    uint8_t length;         /* in 16 byte units */
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t features[5];
+} __attribute__((packed));
+typedef struct mp_floating mp_floating_t;
+
+struct mp_config {
+    uint32_t signature;
+    uint16_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    uint8_t oem_id[8];
+    uint8_t product_id[12];
+    uint32_t oem_table_paddr;
+    uint16_t oem_table_size;
+    uint16_t entry_count;
+    uint32_t apic_paddr;
+    uint16_t extended_length;
+    uint8_t extended_checksum;
+    uint8_t reserved;
+} __attribute__((packed));
+typedef struct mp_config mp_config_t;
+
+struct mp_processor {
+    uint8_t type;
+    uint8_t apic_id;
+    uint8_t apic_version;
+    uint8_t flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed));
+typedef struct mp_processor mp_processor_t;
+
+struct cpu {
+    uint32_t apic_id;
+    uint32_t stack_top;
+    volatile uint32_t started;
+};
+typedef struct cpu cpu_t;
+
+/* defined in loader.s */
+extern uint8_t kernel_stack[];
+
+/* defined in smp_asm.s */
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_end[];
+extern uint32_t smp_trampoline_pdt[];
+extern uint32_t smp_trampoline_stack[];
+
+static cpu_t cpus[SMP_MAX_CPUS];
+static uint32_t num_cpus = 1;       /* the number of CPUs found */
+static volatile uint32_t num_started = 1;
+static uint8_t apic_to_cpu[256];
+
+static uint8_t mp_checksum(uint8_t const *p, uint32_t len)
+{
+    uint8_t sum = 0;
+    while (len--) {
+        sum += *p++;
+    }
+
+    return sum;
+}
+
+static mp_floating_t *mp_search(uint32_t paddr, uint32_t len)
+{
+    uint32_t addr;
+    for (addr = paddr; addr + sizeof(mp_floating_t) <= paddr + len;
+         addr += 16) {
+        mp_floating_t *mpf = (mp_floating_t *) PHYSICAL_TO_VIRTUAL(addr);
+        if (mpf->signature == MP_FLOATING_SIGNATURE &&
+            mp_checksum((uint8_t *) mpf, mpf->length * 16) == 0) {
+            return mpf;
+        }
+    }
+
+    return NULL;
+}
+
+/* The floating pointer is in the first kB of the EBDA, the last kB of base
+ * memory or in the BIOS ROM. All of them are below 1 MB and therefore
+ * mapped by the kernel.
+ */
+static mp_floating_t *mp_find_floating(void)
+{
+    mp_floating_t *mpf;
+    uint32_t ebda = *((uint16_t *) PHYSICAL_TO_VIRTUAL(BDA_EBDA_SEGMENT)) << 4;
+
+    if (ebda != 0 && (mpf = mp_search(ebda, 1024)) != NULL) {
+        return mpf;
+    }
+    if ((mpf = mp_search(BASE_MEMORY_END - 1024, 1024)) != NULL) {
+        return mpf;
+    }
+
+    return mp_search(BIOS_ROM_START, BIOS_ROM_END - BIOS_ROM_START);
+}
+
+/* Returns the physical address of the local APICs, 0 on failure */
+static uint32_t mp_read_config(void)
+{
+    uint32_t i, n;
+    mp_floating_t *mpf = mp_find_floating();
+    if (mpf == NULL || mpf->config_paddr == 0 ||
+        mpf->config_paddr >= BIOS_ROM_END) {
+        return 0;
+    }
+
+    mp_config_t *conf = (mp_config_t *) PHYSICAL_TO_VIRTUAL(mpf->config_paddr);
+    if (conf->signature != MP_CONFIG_SIGNATURE ||
+        mp_checksum((uint8_t *) conf, conf->length) != 0) {
+        log_error("mp_read_config", "Bad MP configuration table\n");
+        return 0;
+    }
+
+    /* the BSP is always cpu 0, the APs follow in table order */
+    n = 1;
+    uint8_t *entry = (uint8_t *) (conf + 1);
+    for (i = 0; i < conf->entry_count; ++i) {
+        if (*entry != MP_ENTRY_PROCESSOR) {
+            entry += MP_OTHER_ENTRY_SIZE;
+            continue;
+        }
+
+        mp_processor_t *proc = (mp_processor_t *) entry;
+        entry += MP_PROCESSOR_ENTRY_SIZE;
+
+        if (!(proc->flags & MP_CPU_ENABLED)) {
+            continue;
+        }
+        if (proc->flags & MP_CPU_BSP) {
+            cpus[0].apic_id = proc->apic_id;
+        } else if (n < SMP_MAX_CPUS) {
+            cpus[n++].apic_id = proc->apic_id;
+        } else {
+            log_info("mp_read_config", "Ignoring CPU with APIC id %u\n",
+                     proc->apic_id);
+        }
+    }
+
+    num_cpus = n;
+    return conf->apic_paddr;
+}
+
+/* Each write to port 0x80 (the POST code port) takes roughly 1 us */
+static void smp_delay(uint32_t us)
+{
+    while (us--) {
+        outb(0x80, 0);
+    }
+}
+
+/* Called from the trampoline in smp_asm.s on the AP's own stack */
+void smp_ap_main(void)
+{
+    uint32_t cpu = smp_cpu_id();
+
+    gdt_load_cpu(cpu);
+    idt_load();
+    apic_enable();
+    fpu_init_cpu();
+    sysenter_init_cpu();
+
+    log_info("smp_ap_main", "cpu %u (APIC id %u) is up\n",
+             cpu, cpus[cpu].apic_id);
+    cpus[cpu].started = 1;
+
+    /* wait for work, the scheduler tick will dispatch it */
+    scheduler_preempt();
+}
+
+static int smp_start_ap(uint32_t cpu)
+{
+    uint32_t us;
+    uint8_t *stack = kmalloc(KERNEL_STACK_SIZE);
+    if (stack == NULL) {
+        log_error("smp_start_ap", "Couldn't allocate a stack for cpu %u\n",
+                  cpu);
+        return -1;
+    }
+    cpus[cpu].stack_top = (uint32_t) stack + KERNEL_STACK_SIZE;
+
+    *smp_trampoline_pdt = paging_kernel_pdt_paddr();
+    *smp_trampoline_stack = cpus[cpu].stack_top;
+    memcpy((void *) PHYSICAL_TO_VIRTUAL(SMP_TRAMPOLINE_PADDR),
+           smp_trampoline_start, smp_trampoline_end - smp_trampoline_start);
+
+    /* INIT-SIPI-SIPI, as described in the MP specification, appendix B */
+    apic_send_init(cpus[cpu].apic_id);
+    smp_delay(10000);
+    apic_send_startup(cpus[cpu].apic_id, SMP_TRAMPOLINE_PADDR);
+    smp_delay(200);
+    if (!cpus[cpu].started) {
+        apic_send_startup(cpus[cpu].apic_id, SMP_TRAMPOLINE_PADDR);
+    }
+
+    for (us = 0; us < SMP_AP_START_TIMEOUT && !cpus[cpu].started; us += 100) {
+        smp_delay(100);
+    }
+
+    if (!cpus[cpu].started) {
+        log_error("smp_start_ap", "cpu %u (APIC id %u) didn't start\n",
+                  cpu, cpus[cpu].apic_id);
+        kfree(stack);
+        return -1;
+    }
+
+    return 0;
+}
+
+void smp_init(void)
+{
+    uint32_t i, apic_paddr;
+
+    cpus[0].stack_top = (uint32_t) kernel_stack + KERNEL_STACK_SIZE;
+    cpus[0].started = 1;
+
+    apic_paddr = mp_read_config();
+    if (apic_paddr == 0) {
+        log_info("smp_init", "No MP table found, using one CPU\n");
+        return;
+    }
+
+    if (apic_init(apic_paddr)) {
+        num_cpus = 1;
+        return;
+    }
+
+    memset(apic_to_cpu, 0, sizeof(apic_to_cpu));
+    for (i = 0; i < num_cpus; ++i) {
+        apic_to_cpu[cpus[i].apic_id] = i;
+    }
+
+    /* the APs are started one at a time and we stop at the first one that
+     * fails, so that [0, smp_num_cpus()) are always the running CPUs
+     */
+    paging_set_identity_map(1);
+    for (i = 1; i < num_cpus; ++i) {
+        if (smp_start_ap(i)) {
+            break;
+        }
+        num_started = i + 1;
+    }
+    paging_set_identity_map(0);
+
+    log_info("smp_init", "%u of %u CPUs are running\n", num_started, num_cpus);
+}
+
+uint32_t smp_num_cpus(void)
+{
+    return num_started;
+}
+
+uint32_t smp_cpu_id(void)
+{
+    if (!apic_is_enabled()) {
+        return 0;
+    }
+
+    return apic_to_cpu[apic_id()];
+}
+
+uint32_t smp_kernel_stack_top(void)
+{
+    return cpus[smp_cpu_id()].stack_top;
+}
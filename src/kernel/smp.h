@@ -0,0 +1,30 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "stdint.h"
+#include "constants.h"
+
+/* Finds the CPUs through the MP table, enables the local APIC and starts the
+ * application processors. Leaves the kernel running on one CPU if there is
+ * no MP table.
+ */
+void smp_init(void);
+
+/* The number of CPUs that are up and running */
+uint32_t smp_num_cpus(void);
+
+/* The index of the calling CPU, in [0, smp_num_cpus()), 0 is the BSP */
+uint32_t smp_cpu_id(void);
+
+/* The top of the calling CPU's own kernel stack, i.e. the stack used when
+ * no process' kernel stack can be used. Called by switch_to_kernel_stack.
+ */
+uint32_t smp_kernel_stack_top(void);
+
+/* defined in smp_asm.s */
+void smp_halt(void);
+void smp_pause(void);
+uint32_t atomic_xchg(volatile uint32_t *ptr, uint32_t value);
+uint32_t atomic_fetch_add(volatile uint32_t *ptr, uint32_t value);
+
+#endif /* SMP_H */
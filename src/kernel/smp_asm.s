@@ -0,0 +1,104 @@
+; the code the application processors (APs) start executing after the
+; STARTUP IPI, together with small helpers needed by the SMP code
+
+%include "constants.inc"
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_trampoline_pdt
+global smp_trampoline_stack
+global smp_halt
+global smp_pause
+global atomic_xchg
+global atomic_fetch_add
+
+extern smp_ap_main
+
+; the trampoline is copied to SMP_TRAMPOLINE_PADDR, so all addresses inside
+; of it must be computed relative to that address
+%define TRAMPOLINE_ADDR(label) \
+    (SMP_TRAMPOLINE_PADDR + (label) - smp_trampoline_start)
+
+section .text
+align 4
+[bits 16]
+smp_trampoline_start:
+    cli
+    xor     ax, ax
+    mov     ds, ax
+    lgdt    [TRAMPOLINE_ADDR(trampoline_gdt_ptr)]
+
+    mov     eax, cr0
+    or      eax, 0x01               ; enable protected mode
+    mov     cr0, eax
+    jmp     dword SEGSEL_KERNEL_CS:TRAMPOLINE_ADDR(trampoline_protected_mode)
+
+[bits 32]
+trampoline_protected_mode:
+    mov     ax, SEGSEL_KERNEL_DS
+    mov     ds, ax
+    mov     es, ax
+    mov     fs, ax
+    mov     gs, ax
+    mov     ss, ax
+
+    ; enable paging the same way loader.s does, the kernel PDT has the lowest
+    ; 4 MB identity mapped while the APs are started
+    mov     eax, [TRAMPOLINE_ADDR(smp_trampoline_pdt)]
+    or      eax, 0x08               ; PWT, same as pdt_set
+    mov     cr3, eax
+
+    mov     eax, cr4
+    or      eax, 0x00000010         ; enable 4 MB pages
+    mov     cr4, eax
+
+    mov     eax, cr0
+    or      eax, 0x80000000         ; enable paging
+    mov     cr0, eax
+
+    mov     esp, [TRAMPOLINE_ADDR(smp_trampoline_stack)]
+    mov     eax, smp_ap_main        ; jump to the higher half
+    call    eax
+.hang:
+    jmp     .hang
+
+align 8
+trampoline_gdt:
+    dq      0                       ; the null entry
+    dq      0x00CF9A000000FFFF      ; flat code segment, same as gdt.c
+    dq      0x00CF92000000FFFF      ; flat data segment, same as gdt.c
+trampoline_gdt_ptr:
+    dw      trampoline_gdt_ptr - trampoline_gdt - 1
+    dd      TRAMPOLINE_ADDR(trampoline_gdt)
+
+; filled in by smp_init before each AP is started
+smp_trampoline_pdt:
+    dd      0                       ; physical address of the kernel PDT
+smp_trampoline_stack:
+    dd      0                       ; virtual address of the top of the stack
+smp_trampoline_end:
+
+; enables interrupts and waits for the next one
+smp_halt:
+    sti
+    hlt
+    ret
+
+; hint to the CPU that we're in a spin loop
+smp_pause:
+    pause
+    ret
+
+; atomically stores value in *ptr and returns the old value of *ptr
+atomic_xchg:
+    mov     ecx, [esp+4]            ; ptr
+    mov     eax, [esp+8]            ; value
+    xchg    [ecx], eax              ; xchg with memory is always locked
+    ret
+
+; atomically adds value to *ptr and returns the old value of *ptr
+atomic_fetch_add:
+    mov     ecx, [esp+4]            ; ptr
+    mov     eax, [esp+8]            ; value
+    lock xadd [ecx], eax
+    ret
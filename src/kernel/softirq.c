@@ -0,0 +1,114 @@
+#include "softirq.h"
+#include "interrupt.h"
+#include "constants.h"
+#include "smp.h"
+#include "stddef.h"
+
+/* how many times the pending softirqs are rerun if they are raised again
+ * while running, the rest are left for the next interrupt */
+#define SOFTIRQ_MAX_RESTARTS 4
+
+struct tasklet_list {
+    tasklet_t *start;
+    tasklet_t *end;
+};
+typedef struct tasklet_list tasklet_list_t;
+
+static softirq_handler_t handlers[SOFTIRQ_NUM];
+
+/* all per CPU, only touched by their CPU with interrupts disabled */
+static uint32_t pending[SMP_MAX_CPUS];
+static uint32_t in_softirq[SMP_MAX_CPUS];
+static tasklet_list_t tasklets[SMP_MAX_CPUS];
+
+int softirq_register(uint32_t nr, softirq_handler_t handler)
+{
+    if (nr >= SOFTIRQ_NUM || handlers[nr] != NULL) {
+        return -1;
+    }
+
+    handlers[nr] = handler;
+    return 0;
+}
+
+void softirq_raise(uint32_t nr)
+{
+    uint32_t flags = interrupts_save_and_disable();
+    pending[smp_cpu_id()] |= 0x01 << nr;
+    interrupts_restore(flags);
+}
+
+int softirq_run(void)
+{
+    uint32_t nr, work, restarts = SOFTIRQ_MAX_RESTARTS;
+    uint32_t cpu = smp_cpu_id();
+
+    if (in_softirq[cpu]) {
+        /* the interrupted softirq picks up the new work */
+        return 0;
+    }
+
+    in_softirq[cpu] = 1;
+    while (pending[cpu] != 0 && restarts-- > 0) {
+        work = pending[cpu];
+        pending[cpu] = 0;
+
+        /* in_softirq keeps the CPU from switching process while the
+         * interrupts are enabled, so cpu stays valid */
+        enable_interrupts();
+        for (nr = 0; nr < SOFTIRQ_NUM; ++nr) {
+            if ((work & (0x01 << nr)) && handlers[nr] != NULL) {
+                handlers[nr]();
+            }
+        }
+        disable_interrupts();
+    }
+    in_softirq[cpu] = 0;
+
+    return 1;
+}
+
+void tasklet_schedule(tasklet_t *t)
+{
+    uint32_t cpu, flags = interrupts_save_and_disable();
+    cpu = smp_cpu_id();
+
+    if (!t->scheduled) {
+        t->scheduled = 1;
+        t->next = NULL;
+        if (tasklets[cpu].start == NULL) {
+            tasklets[cpu].start = t;
+        } else {
+            tasklets[cpu].end->next = t;
+        }
+        tasklets[cpu].end = t;
+        pending[cpu] |= 0x01 << SOFTIRQ_TASKLET;
+    }
+
+    interrupts_restore(flags);
+}
+
+static void tasklet_action(void)
+{
+    tasklet_t *t, *next;
+    uint32_t cpu;
+
+    disable_interrupts();
+    cpu = smp_cpu_id();
+    t = tasklets[cpu].start;
+    tasklets[cpu].start = NULL;
+    tasklets[cpu].end = NULL;
+    enable_interrupts();
+
+    for (; t != NULL; t = next) {
+        next = t->next;
+        /* cleared first, so the tasklet can schedule itself again */
+        t->scheduled = 0;
+        t->fn(t->data);
+    }
+}
+
+void softirq_init(void)
+{
+    softirq_register(SOFTIRQ_TASKLET, &tasklet_action);
+}
@@ -0,0 +1,45 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include "stdint.h"
+
+/* Softirqs are the bottom halves of the interrupt handlers. The top half
+ * only does what must be done before the interrupt is acknowledged and
+ * raises a softirq for the rest, which then runs with interrupts enabled
+ * when the outermost interrupt handler returns.
+ */
+#define SOFTIRQ_TASKLET     0
+#define SOFTIRQ_KMSG        1
+#define SOFTIRQ_NUM         8
+
+typedef void (*softirq_handler_t)(void);
+
+int softirq_register(uint32_t nr, softirq_handler_t handler);
+/* marks the softirq as pending on the calling CPU */
+void softirq_raise(uint32_t nr);
+/* Runs the pending softirqs of the calling CPU, must be called with
+ * interrupts disabled and returns with them disabled.
+ *
+ * @return 0 if called from within a softirq, 1 otherwise
+ */
+int softirq_run(void);
+
+/* A tasklet is a function that is deferred to SOFTIRQ_TASKLET on the CPU
+ * that scheduled it. Scheduling a tasklet that is already scheduled does
+ * nothing, a running tasklet may be scheduled again.
+ */
+struct tasklet {
+    void (*fn)(uint32_t data);
+    uint32_t data;
+    uint32_t scheduled;
+    struct tasklet *next;
+};
+typedef struct tasklet tasklet_t;
+
+#define TASKLET_INIT(fn, data) { (fn), (data), 0, 0 }
+
+void tasklet_schedule(tasklet_t *t);
+
+void softirq_init(void);
+
+#endif /* SOFTIRQ_H */
@@ -0,0 +1,208 @@
+#include "spinlock.h"
+#include "smp.h"
+#include "tsc.h"
+#include "interrupt.h"
+#include "stdio.h"
+#include "stddef.h"
+#include "common.h"
+
+/* protects the list of locks, can't be a spinlock_t itself since taking one
+ * might register it
+ */
+static volatile uint32_t registry_locked = 0;
+static spinlock_t *registry = NULL;
+static vnodeops_t vnodeops;
+
+/* the counters of a lock, as shown by /dev/lockstat */
+struct lockstat {
+    char const *name;
+    uint32_t acquisitions;
+    uint32_t contentions;
+    uint64_t spin_cycles;
+    uint64_t hold_cycles;
+    uint64_t max_hold_cycles;
+};
+typedef struct lockstat lockstat_t;
+
+static void registry_lock(void)
+{
+    while (atomic_xchg(&registry_locked, 1)) {
+        smp_pause();
+    }
+}
+
+static void registry_unlock(void)
+{
+    atomic_xchg(&registry_locked, 0);
+}
+
+static void spinlock_register(spinlock_t *lock)
+{
+    registry_lock();
+    lock->next = registry;
+    registry = lock;
+    lock->registered = 1;
+    registry_unlock();
+}
+
+/* Locks are only ever added in front of the list and next is set before a
+ * lock is added, so the list can be walked from the head without the lock.
+ */
+static spinlock_t *registry_head(void)
+{
+    spinlock_t *head;
+    /* an interrupt might take, and register, a lock on this CPU */
+    uint32_t flags = interrupts_save_and_disable();
+
+    registry_lock();
+    head = registry;
+    registry_unlock();
+
+    interrupts_restore(flags);
+    return head;
+}
+
+void spin_lock(spinlock_t *lock)
+{
+    uint64_t start, now;
+
+    if (atomic_xchg(&lock->locked, 1) == 0) {
+        lock->acquired_at = tsc_read();
+    } else {
+        start = tsc_read();
+        while (lock->locked || atomic_xchg(&lock->locked, 1)) {
+            smp_pause();
+        }
+        now = tsc_read();
+
+        lock->contentions++;
+        lock->spin_cycles += now - start;
+        lock->acquired_at = now;
+    }
+
+    lock->acquisitions++;
+    if (!lock->registered) {
+        spinlock_register(lock);
+    }
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+    uint64_t held = tsc_read() - lock->acquired_at;
+
+    lock->hold_cycles += held;
+    if (held > lock->max_hold_cycles) {
+        lock->max_hold_cycles = held;
+    }
+
+    atomic_xchg(&lock->locked, 0);
+}
+
+uint32_t spin_lock_irqsave(spinlock_t *lock)
+{
+    uint32_t flags = interrupts_save_and_disable();
+    spin_lock(lock);
+
+    return flags;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags)
+{
+    spin_unlock(lock);
+    interrupts_restore(flags);
+}
+
+static int lockstat_open(vnode_t *n)
+{
+    UNUSED_ARGUMENT(n);
+
+    return 0;
+}
+
+static int lockstat_lookup(vnode_t *n, char const *p, vnode_t *o)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(p);
+    UNUSED_ARGUMENT(o);
+
+    return -1;
+}
+
+/* The output has one line per lock that has been taken at least once, the
+ * cycle counts are in units of 1024 cycles:
+ *
+ *     # name acquisitions contentions spin hold max_hold
+ *     scheduler 5021 12 3 911 2
+ *     ...
+ *
+ * Like /dev/schedstat the output must be read in one go, it is cut short at
+ * count bytes and any offset past the start of the file reads as its end.
+ */
+static int lockstat_read(vnode_t *n, void *buf, size_t count, uint32_t offset)
+{
+    UNUSED_ARGUMENT(n);
+
+    spinlock_t *lock;
+    lockstat_t stat;
+    char *str = buf;
+    size_t len = 0;
+
+    if (count == 0 || offset != 0) {
+        return 0;
+    }
+
+    len += snprintf(str, count,
+                    "# name acquisitions contentions spin hold max_hold\n");
+    for (lock = registry_head(); lock != NULL; lock = lock->next) {
+        /* the holder keeps updating the counters, take a copy of them
+         * before writing to buf */
+        stat.name = lock->name;
+        stat.acquisitions = lock->acquisitions;
+        stat.contentions = lock->contentions;
+        stat.spin_cycles = lock->spin_cycles;
+        stat.hold_cycles = lock->hold_cycles;
+        stat.max_hold_cycles = lock->max_hold_cycles;
+
+        len += snprintf(str + len, count - len, "%s %u %u %u %u %u\n",
+                        stat.name, stat.acquisitions, stat.contentions,
+                        (uint32_t) (stat.spin_cycles >> 10),
+                        (uint32_t) (stat.hold_cycles >> 10),
+                        (uint32_t) (stat.max_hold_cycles >> 10));
+    }
+
+    return len;
+}
+
+static int lockstat_write(vnode_t *n, char const *buf, size_t count)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(buf);
+    UNUSED_ARGUMENT(count);
+
+    return -1;
+}
+
+static int lockstat_getattr(vnode_t *n, vattr_t *attr)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(attr);
+
+    return -1;
+}
+
+void lockstat_init(void)
+{
+    vnodeops.vn_open = &lockstat_open;
+    vnodeops.vn_lookup = &lockstat_lookup;
+    vnodeops.vn_read = &lockstat_read;
+    vnodeops.vn_write = &lockstat_write;
+    vnodeops.vn_getattr = &lockstat_getattr;
+}
+
+int lockstat_get_vnode(vnode_t *out)
+{
+    out->v_op = &vnodeops;
+    out->v_data = 0;
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "stdint.h"
+#include "vnode.h"
+
+struct spinlock {
+    volatile uint32_t locked;
+    char const *name;
+
+    /* statistics, only updated by the holder of the lock */
+    uint64_t acquired_at;       /* TSC when the lock was taken */
+    uint32_t acquisitions;
+    uint32_t contentions;       /* acquisitions that had to spin */
+    uint64_t spin_cycles;
+    uint64_t hold_cycles;
+    uint64_t max_hold_cycles;
+
+    uint32_t registered;
+    struct spinlock *next;      /* all locks that have been used */
+};
+typedef struct spinlock spinlock_t;
+
+#define SPINLOCK_INIT(name) { 0, (name), 0, 0, 0, 0, 0, 0, 0, 0 }
+
+/* Takes the lock without touching the interrupt flag. Must only be used
+ * when interrupts are already disabled, otherwise an interrupt on the same
+ * CPU might spin forever on the lock.
+ */
+void spin_lock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+
+/* Disables interrupts and takes the lock, returns the old EFLAGS that must
+ * be given to spin_unlock_irqrestore.
+ */
+uint32_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, uint32_t flags);
+
+/* /dev/lockstat */
+void lockstat_init(void);
+int lockstat_get_vnode(vnode_t *out);
+
+#endif /* SPINLOCK_H */
@@ -42,4 +42,90 @@ void printf(char *s, ...)
     }
 
     va_end(ap);
+    fb_flush();
+}
+
+struct sbuf {
+    char *str;
+    size_t size;
+    size_t len;
+};
+typedef struct sbuf sbuf_t;
+
+static void sbuf_put_b(sbuf_t *b, char c)
+{
+    if (b->len + 1 < b->size) {
+        b->str[b->len++] = c;
+    }
+}
+
+static void sbuf_put_ui(sbuf_t *b, uint32_t i)
+{
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + i % 10;
+        i /= 10;
+    } while (i > 0);
+
+    while (n > 0) {
+        sbuf_put_b(b, digits[--n]);
+    }
+}
+
+static void sbuf_put_ui_hex(sbuf_t *b, uint32_t n)
+{
+    char *chars = "0123456789ABCDEF";
+    int i;
+
+    sbuf_put_b(b, '0');
+    sbuf_put_b(b, 'x');
+
+    for (i = 7; i >= 0; --i) {
+        sbuf_put_b(b, chars[(n >> i*4) & 0x0F]);
+    }
+}
+
+int snprintf(char *str, size_t size, char *fmt, ...)
+{
+    va_list ap;
+    char *p;
+    char *sval;
+    sbuf_t b = { str, size, 0 };
+
+    va_start(ap, fmt);
+    for (p = fmt; *p != '\0'; ++p) {
+        if (*p != '%') {
+            sbuf_put_b(&b, *p);
+            continue;
+        }
+
+        switch (*++p) {
+            case 'c':
+                sbuf_put_b(&b, (char) va_arg(ap, uint32_t));
+                break;
+            case 'u':
+                sbuf_put_ui(&b, va_arg(ap, uint32_t));
+                break;
+            case 'X':
+                sbuf_put_ui_hex(&b, va_arg(ap, uint32_t));
+                break;
+            case 's':
+                for (sval = va_arg(ap, char *); *sval; ++sval) {
+                    sbuf_put_b(&b, *sval);
+                }
+                break;
+            case '%':
+                sbuf_put_b(&b, '%');
+                break;
+        }
+    }
+    va_end(ap);
+
+    if (size > 0) {
+        str[b.len] = '\0';
+    }
+
+    return b.len;
 }
@@ -1,6 +1,8 @@
 #ifndef STDIO_H
 #define STDIO_H
 
+#include "stddef.h"
+
 /** 
  * Prints a formatted string to the framebuffer.
  * The current supported types are:
@@ -14,4 +16,16 @@
  */
 void printf(char *fmt, ...);
 
+/**
+ * Writes a formatted string to a buffer, supporting the same types as printf.
+ * At most size - 1 characters are written and the string is always
+ * terminated with a '\0' (if size > 0).
+ *
+ * @param str  The buffer to write the string to
+ * @param size The size of the buffer in bytes
+ * @param fmt  The format string
+ * @return The number of characters written, excluding the '\0'
+ */
+int snprintf(char *str, size_t size, char *fmt, ...);
+
 #endif /* STDIO_H */
@@ -1,3 +1,5 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SYSCALL
+
 #include "common.h"
 #include "interrupt.h"
 #include "log.h"
@@ -6,57 +8,169 @@
 #include "scheduler.h"
 #include "kmalloc.h"
 #include "process.h"
+#include "constants.h"
+#include "ring.h"
+
+#define NUM_SYSCALLS 15
+#define SYSCALL_MAX_ARGS 5
+/* lseek returns the new offset as an int */
+#define SYSCALL_OFFSET_MAX 0x7FFFFFFF
+/* the most pids returned by one getpids */
+#define SYSCALL_MAX_PIDS 64
+/* the arguments are passed in ebx, ecx, edx, esi and edi */
+#define SYSCALL_ARG(args, i, type) ((type) (args)[(i)])
+
+typedef int (*syscall_handler_t)(uint32_t syscall, uint32_t const *args);
+
+/* Checks that a buffer passed by user mode doesn't reach into the kernel */
+static int is_user_buffer(void const *buf, uint32_t size)
+{
+    uint32_t start = (uint32_t) buf;
+    return start < KERNEL_START_VADDR && size <= KERNEL_START_VADDR - start;
+}
 
-#define NUM_SYSCALLS 8
-#define NEXT_STACK_ITEM(stack) ((uint32_t *) (stack) + 1)
-#define PEEK_STACK(stack, type) (*((type *) (stack)))
+/* Checks that a NUL-terminated string passed by user mode is at most max
+ * bytes long, the NUL included, and doesn't reach into the kernel. Every page
+ * is checked before it is read, so no byte of the kernel is ever read.
+ */
+static int is_user_string(char const *str, uint32_t max)
+{
+    uint32_t i, addr = (uint32_t) str;
 
-typedef int (*syscall_handler_t)(uint32_t syscall, void *stack);
+    for (i = 0; i < max; ++i, ++addr) {
+        if ((i == 0 || addr % FOUR_KB == 0) && addr >= KERNEL_START_VADDR) {
+            return 0;
+        }
+        if (str[i] == '\0') {
+            return 1;
+        }
+    }
 
-static int sys_read(uint32_t syscall, void *stack)
+    return 0;
+}
+
+static int sys_read(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
 
-    uint32_t fd = PEEK_STACK(stack, uint32_t);
-    stack = NEXT_STACK_ITEM(stack);
+    uint32_t fd = SYSCALL_ARG(args, 0, uint32_t);
+    char *buf = SYSCALL_ARG(args, 1, char *);
+    size_t count = SYSCALL_ARG(args, 2, size_t);
+
+    ps_t *ps = scheduler_get_current_process();
+
+    if (!is_user_buffer(buf, count)) {
+        return -1;
+    }
+
+    if (fd >= PROCESS_MAX_NUM_FD) {
+        log_debug("sys_read", "pid %u tried to open bad fd %u\n",
+                  ps->id, fd);
+        return -1;
+    }
+
+    fd_t *f = &ps->file_descriptors[fd];
+    if (f->vnode == NULL) {
+        log_debug("sys_read", "Couldn't find vnode for fd %u, pid %u\n",
+                  fd, ps->id);
+        return -1;
+    }
+
+    int read = vfs_read(f->vnode, buf, count, f->offset);
+    if (read > 0) {
+        f->offset += read;
+    }
+
+    return read;
+}
 
-    char *buf = PEEK_STACK(stack, char *);
-    stack = NEXT_STACK_ITEM(stack);
+static int sys_pread(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
 
-    size_t count = PEEK_STACK(stack, size_t);
+    uint32_t fd = SYSCALL_ARG(args, 0, uint32_t);
+    char *buf = SYSCALL_ARG(args, 1, char *);
+    size_t count = SYSCALL_ARG(args, 2, size_t);
+    uint32_t offset = SYSCALL_ARG(args, 3, uint32_t);
 
     ps_t *ps = scheduler_get_current_process();
 
-    if (fd >= PROCESS_MAX_NUM_FD) {
-        log_info("sys_read", "pid %u tried to open bad fd %u\n",
-                 ps->id, fd);
+    if (fd >= PROCESS_MAX_NUM_FD || !is_user_buffer(buf, count)) {
         return -1;
     }
 
     vnode_t *vnode = ps->file_descriptors[fd].vnode;
     if (vnode == NULL) {
-        log_info("sys_read", "Couldn't find vnode for fd %u, pid %u\n",
-                 fd, ps->id);
         return -1;
     }
 
-    return vnode->v_op->vn_read(vnode, buf, count);
+    /* doesn't move the file's offset */
+    return vfs_read(vnode, buf, count, offset);
 }
 
-static int sys_write(uint32_t syscall, void *stack)
+static int sys_lseek(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
 
-    uint32_t fd = PEEK_STACK(stack, uint32_t);
-    stack = NEXT_STACK_ITEM(stack);
+    uint32_t fd = SYSCALL_ARG(args, 0, uint32_t);
+    int offset = SYSCALL_ARG(args, 1, int);
+    uint32_t whence = SYSCALL_ARG(args, 2, uint32_t);
+    vattr_t attr;
+    uint32_t base;
+
+    ps_t *ps = scheduler_get_current_process();
+
+    if (fd >= PROCESS_MAX_NUM_FD) {
+        return -1;
+    }
+
+    fd_t *f = &ps->file_descriptors[fd];
+    if (f->vnode == NULL) {
+        return -1;
+    }
+
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = f->offset;
+            break;
+        case SEEK_END:
+            if (vfs_getattr(f->vnode, &attr)) {
+                return -1;
+            }
+            base = attr.file_size;
+            break;
+        default:
+            return -1;
+    }
+
+    /* checked without computing base + offset, which could overflow */
+    if (base > SYSCALL_OFFSET_MAX ||
+        (offset > 0 && base > (uint32_t) (SYSCALL_OFFSET_MAX - offset)) ||
+        (offset < 0 && base < 0u - (uint32_t) offset)) {
+        return -1;
+    }
+    f->offset = base + (uint32_t) offset;
+
+    return f->offset;
+}
 
-    char const *str = PEEK_STACK(stack, char const *);
-    stack = NEXT_STACK_ITEM(stack);
+static int sys_write(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
 
-    size_t len = PEEK_STACK(stack, size_t);
+    uint32_t fd = SYSCALL_ARG(args, 0, uint32_t);
+    char const *str = SYSCALL_ARG(args, 1, char const *);
+    size_t len = SYSCALL_ARG(args, 2, size_t);
 
     ps_t *ps = scheduler_get_current_process();
 
+    if (fd >= PROCESS_MAX_NUM_FD || !is_user_buffer(str, len)) {
+        return -1;
+    }
+
     vnode_t *vn = ps->file_descriptors[fd].vnode;
     if (vn == NULL) {
     	log_error("sys_write",
@@ -81,30 +195,40 @@ static int get_next_fd(fd_t *fds, uint32_t num_fds)
     return -1;
 }
 
-static int sys_open(uint32_t syscall, void *stack)
+static int sys_open(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
 
-    char const *path = PEEK_STACK(stack, char const *);
-    stack = NEXT_STACK_ITEM(stack);
+    char const *path = SYSCALL_ARG(args, 0, char const *);
 
     /* flags and mode isn't used at the moment */
 
     ps_t *ps = scheduler_get_current_process();
 
+    if (!is_user_string(path, VFS_PATH_MAX)) {
+        return -1;
+    }
+
     vnode_t *vnode = kmalloc(sizeof(vnode_t));
+    if (vnode == NULL) {
+        log_error("sys_open", "Could not allocate a vnode for ps %u\n",
+                  ps->id);
+        return -1;
+    }
+
     if(vfs_lookup(path, vnode)) {
-        log_info("sys_open",
-                 "process %u tried to open non existing file %s.\n",
-                 ps->id, path);
+        log_debug("sys_open",
+                  "process %u tried to open non existing file %s.\n",
+                  ps->id, path);
+        kfree(vnode);
         return -1;
     }
 
     int fd = get_next_fd(ps->file_descriptors, PROCESS_MAX_NUM_FD);
     if (fd == -1) {
-        log_info("sys_open",
-                 "File descriptor table for ps %u is full.\n",
-                 ps->id);
+        log_debug("sys_open",
+                  "File descriptor table for ps %u is full.\n",
+                  ps->id);
         kfree(vnode);
         return -1;
     }
@@ -118,6 +242,7 @@ static int sys_open(uint32_t syscall, void *stack)
     }
 
     ps->file_descriptors[fd].vnode = vnode;
+    ps->file_descriptors[fd].offset = 0;
 
     return fd;
 }
@@ -134,14 +259,17 @@ static void continue_execve(uint32_t data)
     /* will never reach this code */
 }
 
-static int sys_execve(uint32_t syscall, void *stack)
+static int sys_execve(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
 
     char const *path;
     ps_t *current, *new;
 
-    path = PEEK_STACK(stack, char const *);
+    path = SYSCALL_ARG(args, 0, char const *);
+    if (!is_user_string(path, VFS_PATH_MAX)) {
+        return -1;
+    }
     current = scheduler_get_current_process();
     new = process_create_replacement(current, path);
     if (new == NULL) {
@@ -157,19 +285,26 @@ static int sys_execve(uint32_t syscall, void *stack)
     return 0;
 }
 
-static int sys_fork(uint32_t syscall, void *stack)
+static int sys_fork(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
-    UNUSED_ARGUMENT(stack);
+    UNUSED_ARGUMENT(args);
 
     ps_t *parent, *new;
 
-    uint32_t new_pid = scheduler_next_pid();
     parent = scheduler_get_current_process();
+    uint32_t new_pid = scheduler_next_pid();
+    if (new_pid == 0) {
+        log_error("sys_fork", "no free pid for fork of process %u\n",
+                  parent->id);
+        return -1;
+    }
+
     new = process_clone(parent, new_pid);
     if (new == NULL) {
         log_error("sys_fork", "can't create fork of process %u\n",
                   parent->id);
+        scheduler_release_pid(new_pid);
         return -1;
     }
 
@@ -181,13 +316,14 @@ static int sys_fork(uint32_t syscall, void *stack)
     return new_pid;
 }
 
-static int sys_yield(uint32_t syscall, void *stack)
+static int sys_yield(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
-    UNUSED_ARGUMENT(stack);
+    UNUSED_ARGUMENT(args);
 
     ps_t *ps = scheduler_get_current_process();
     ps->user_mode.eax = 0;
+    ps->rusage.nvcsw++;
 
     disable_interrupts();
     ps->current = ps->user_mode;
@@ -199,47 +335,37 @@ static int sys_yield(uint32_t syscall, void *stack)
     return -1;
 }
 
-static void continue_exit(uint32_t data)
-{
-    UNUSED_ARGUMENT(data);
-    ps_t *ps = scheduler_get_current_process();
-
-    scheduler_terminate_process(ps);
-
-    scheduler_schedule();
-    /* we should never get here */
-}
-
-static int sys_exit(uint32_t syscall, void *stack)
+static int sys_exit(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
-    UNUSED_ARGUMENT(stack);
+    UNUSED_ARGUMENT(args);
 
-    /* TODO: use exit status from stack */
+    /* TODO: use the exit status in ebx */
 
-    switch_to_kernel_stack(continue_exit, 0);
+    scheduler_exit();
 
     /* we should never get here */
     return -1;
 }
 
-static int sys_wait(uint32_t syscall, void *stack)
+static int sys_wait(uint32_t syscall, uint32_t const *args)
 {
     UNUSED_ARGUMENT(syscall);
-    UNUSED_ARGUMENT(stack);
+    UNUSED_ARGUMENT(args);
 
     ps_t *ps = scheduler_get_current_process();
 
-    if (!scheduler_num_children(ps->id)) {
+    if (!scheduler_num_children(ps)) {
         return -1;
     }
 
     while (1) {
         if (scheduler_has_any_child_terminated(ps)) {
             /* will be turned to user mode process by wrapper */
-            return 0;
+            return scheduler_reap_child(ps);
         } else {
             /* should continue to be kernel process */
+            ps->rusage.nvcsw++;
             snapshot_and_schedule(&ps->current);
         }
     }
@@ -249,6 +375,104 @@ static int sys_wait(uint32_t syscall, void *stack)
     return -1;
 }
 
+static int sys_getrusage(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
+
+    uint32_t pid = SYSCALL_ARG(args, 0, uint32_t);
+    rusage_t *usage = SYSCALL_ARG(args, 1, rusage_t *);
+
+    if (!is_user_buffer(usage, sizeof(rusage_t))) {
+        return -1;
+    }
+
+    rusage_t copy;
+    if (scheduler_get_rusage(pid, &copy)) {
+        return -1;
+    }
+
+    /* the user buffer might fault, so it isn't written under the lock */
+    *usage = copy;
+
+    return 0;
+}
+
+static int sys_getpids(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
+
+    uint32_t *pids = SYSCALL_ARG(args, 0, uint32_t *);
+    uint32_t count = SYSCALL_ARG(args, 1, uint32_t);
+    uint32_t copy[SYSCALL_MAX_PIDS], i, n;
+
+    if (count > SYSCALL_MAX_PIDS) {
+        count = SYSCALL_MAX_PIDS;
+    }
+    if (!is_user_buffer(pids, count * sizeof(uint32_t))) {
+        return -1;
+    }
+
+    n = scheduler_get_pids(copy, count);
+    for (i = 0; i < n; ++i) {
+        pids[i] = copy[i];
+    }
+
+    return n;
+}
+
+static int sys_setpriority(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
+
+    uint32_t pid = SYSCALL_ARG(args, 0, uint32_t);
+    sched_param_t *param = SYSCALL_ARG(args, 1, sched_param_t *);
+
+    if (!is_user_buffer(param, sizeof(sched_param_t))) {
+        return -1;
+    }
+
+    /* copied first, the user buffer can't be read under the lock */
+    sched_param_t copy = *param;
+
+    return scheduler_set_param_pid(pid, &copy);
+}
+
+static int sys_ring_setup(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
+
+    uint32_t entries = SYSCALL_ARG(args, 0, uint32_t);
+    ps_t *ps = scheduler_get_current_process();
+
+    if (ps->ring != NULL) {
+        return -1;
+    }
+
+    ps->ring = ring_create(ps->pdt, entries);
+    if (ps->ring == NULL) {
+        return -1;
+    }
+
+    return RING_USER_VADDR;
+}
+
+static int ring_exec(uint32_t opcode, uint32_t const *args);
+
+static int sys_ring_enter(uint32_t syscall, uint32_t const *args)
+{
+    UNUSED_ARGUMENT(syscall);
+
+    uint32_t to_submit = SYSCALL_ARG(args, 0, uint32_t);
+    ps_t *ps = scheduler_get_current_process();
+
+    if (ps->ring == NULL) {
+        return -1;
+    }
+
+    /* all submissions complete synchronously */
+    return ring_submit(ps->ring, to_submit, &ring_exec);
+}
+
 static syscall_handler_t handlers[NUM_SYSCALLS] = {
 /* 0 */ sys_open,
 /* 1 */ sys_read,
@@ -258,8 +482,50 @@ static syscall_handler_t handlers[NUM_SYSCALLS] = {
 /* 5 */ sys_yield,
 /* 6 */ sys_exit,
 /* 7 */ sys_wait,
+/* 8 */ sys_getrusage,
+/* 9 */ sys_setpriority,
+/* 10 */ sys_ring_setup,
+/* 11 */ sys_ring_enter,
+/* 12 */ sys_lseek,
+/* 13 */ sys_pread,
+/* 14 */ sys_getpids,
+    };
+
+/* the syscalls that can be submitted through the ring, the ones that switch
+ * process can't be since the ring is run from within a syscall */
+static uint8_t ring_ops[NUM_SYSCALLS] = {
+/* 0 */ 1, /* open */
+/* 1 */ 1, /* read */
+/* 2 */ 1, /* write */
+/* 3 */ 0, /* execve */
+/* 4 */ 0, /* fork */
+/* 5 */ 0, /* yield */
+/* 6 */ 0, /* exit */
+/* 7 */ 0, /* wait */
+/* 8 */ 1, /* getrusage */
+/* 9 */ 1, /* setpriority */
+/* 10 */ 0, /* ring_setup */
+/* 11 */ 0, /* ring_enter */
+/* 12 */ 1, /* lseek */
+/* 13 */ 0, /* pread, needs more arguments than a ring entry has */
+/* 14 */ 1, /* getpids */
     };
 
+static int ring_exec(uint32_t opcode, uint32_t const *args)
+{
+    uint32_t i, all_args[SYSCALL_MAX_ARGS] = { 0 };
+
+    if (opcode >= NUM_SYSCALLS || !ring_ops[opcode]) {
+        return -1;
+    }
+
+    for (i = 0; i < RING_MAX_ARGS; ++i) {
+        all_args[i] = args[i];
+    }
+
+    return handlers[opcode](opcode, all_args);
+}
+
 static void update_user_mode_registers(ps_t *ps, cpu_state_t cs,
                                        stack_state_t es)
 {
@@ -283,19 +549,29 @@ registers_t *syscall_handle_interrupt(cpu_state_t cpu_state,
     ps_t *ps = scheduler_get_current_process();
     update_user_mode_registers(ps, cpu_state, exec_state);
 
-    uint32_t *user_stack = (uint32_t *) exec_state.user_esp;
-    uint32_t syscall = *user_stack;
+    uint32_t syscall = ps->user_mode.eax;
 
     if (syscall >= NUM_SYSCALLS) {
-        log_info("syscall_handle_interrupt",
-                 "bad syscall used." "syscall: %u, ps: %u\n", syscall, ps->id);
+        log_debug("syscall_handle_interrupt",
+                  "bad syscall used." "syscall: %u, ps: %u\n", syscall, ps->id);
         ps->user_mode.eax = -1;
         return &ps->user_mode;
     }
 
-    int eax = handlers[syscall](syscall, user_stack + 1);
+    uint32_t args[SYSCALL_MAX_ARGS] = {
+        ps->user_mode.ebx, ps->user_mode.ecx, ps->user_mode.edx,
+        ps->user_mode.esi, ps->user_mode.edi
+    };
+    int eax = handlers[syscall](syscall, args);
 
     disable_interrupts();
     ps->user_mode.eax = eax;
+
+    /* the syscall might have made a more important process runnable */
+    if (scheduler_should_preempt()) {
+        ps->current = ps->user_mode;
+        scheduler_preempt();
+    }
+
     return &ps->user_mode;
 }
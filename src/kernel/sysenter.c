@@ -0,0 +1,50 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_SYSCALL
+
+#include "sysenter.h"
+#include "msr.h"
+#include "constants.h"
+#include "log.h"
+#include "smp.h"
+
+#define CPUID_FEATURE_SEP   (1 << 11)
+
+/* defined in fpu_asm.s */
+uint32_t fpu_cpuid_features(void);
+/* defined in interrupt_asm.s */
+void handle_sysenter(void);
+
+static uint32_t sysenter_enabled = 0;
+
+void sysenter_init_cpu(void)
+{
+    if (!sysenter_enabled) {
+        return;
+    }
+
+    /* SYSEXIT derives the user segments from the kernel CS, which is why the
+     * user segments must follow the kernel segments in the GDT */
+    msr_write(MSR_SYSENTER_CS, SEGSEL_KERNEL_CS);
+    msr_write(MSR_SYSENTER_EIP, (uint32_t) &handle_sysenter);
+    msr_write(MSR_SYSENTER_ESP, smp_kernel_stack_top());
+}
+
+int sysenter_init(void)
+{
+    if (!(fpu_cpuid_features() & CPUID_FEATURE_SEP)) {
+        log_info("sysenter_init",
+                 "SYSENTER isn't supported, using int 0xAE only\n");
+        return 0;
+    }
+
+    sysenter_enabled = 1;
+    sysenter_init_cpu();
+
+    return 0;
+}
+
+void sysenter_set_kernel_stack(uint32_t esp)
+{
+    if (sysenter_enabled) {
+        msr_write(MSR_SYSENTER_ESP, esp);
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef SYSENTER_H
+#define SYSENTER_H
+
+#include "stdint.h"
+
+/* SYSENTER/SYSEXIT is a faster way into the kernel than int 0xAE. User mode
+ * passes its esp in ecx and the address to return to in edx. The syscall
+ * number is in eax as for int 0xAE, but since ecx and edx are taken only
+ * three arguments can be passed: in ebx, esi and edi. The return value is in
+ * eax, ecx and edx are clobbered and esi and edi hold the second and third
+ * argument.
+ */
+
+/* checks that the CPU supports SYSENTER and configures the BSP */
+int sysenter_init(void);
+/* configures the calling AP */
+void sysenter_init_cpu(void);
+/* SYSENTER doesn't use the TSS, so the kernel stack of the process that is
+ * about to run must be set as well */
+void sysenter_set_kernel_stack(uint32_t esp);
+
+#endif /* SYSENTER_H */
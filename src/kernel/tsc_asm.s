@@ -0,0 +1,6 @@
+global tsc_read
+
+section .text
+tsc_read:
+    rdtsc               ; loads the time stamp counter into edx:eax
+    ret                 ; a 64 bit value is returned in edx:eax by cdecl
@@ -1,15 +1,17 @@
 #include "tss.h"
 #include "log.h"
+#include "smp.h"
 
-static tss_t tss;
+static tss_t tss[SMP_MAX_CPUS];
 
-uint32_t tss_init()
+uint32_t tss_vaddr(uint32_t cpu)
 {
-    return (uint32_t) &tss;
+    return (uint32_t) &tss[cpu];
 }
 
 void tss_set_kernel_stack(uint16_t segsel, uint32_t vaddr)
 {
-    tss.esp0 = vaddr;
-    tss.ss0 = segsel;
+    uint32_t cpu = smp_cpu_id();
+    tss[cpu].esp0 = vaddr;
+    tss[cpu].ss0 = segsel;
 }
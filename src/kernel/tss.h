@@ -51,10 +51,11 @@ struct tss {
 
 typedef struct tss tss_t;
 
-uint32_t tss_init();
+uint32_t tss_vaddr(uint32_t cpu);
 
 void tss_load_and_set(uint16_t tss_segsel); /* defined in tss_asm.s */
 
+/* sets the kernel stack in the TSS of the calling CPU */
 void tss_set_kernel_stack(uint16_t segsel, uint32_t vaddr);
 
 #endif /* TSS_H */
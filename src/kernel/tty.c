@@ -0,0 +1,176 @@
+#include "tty.h"
+#include "fb.h"
+#include "string.h"
+#include "common.h"
+
+#define TTY_BACKSPACE   8
+#define TTY_DELETE      127
+
+static vnodeops_t vnodeops;
+static tty_t console;
+
+static void tty_echo(tty_t *tty, char const *buf, size_t len)
+{
+    tty->output(tty, buf, len);
+}
+
+void tty_input(tty_t *tty, char c)
+{
+    uint32_t flags = spin_lock_irqsave(&tty->lock);
+    uint32_t used = tty->tail - tty->head;
+
+    if (c == '\r') {
+        c = '\n';
+    } else if (c == TTY_DELETE) {
+        c = TTY_BACKSPACE;
+    }
+
+    if (c == TTY_BACKSPACE) {
+        /* only the line being edited can be changed */
+        if (tty->tail != tty->line_end) {
+            tty->tail--;
+            tty_echo(tty, tty->erase, strlen(tty->erase));
+        }
+    } else if (c == '\n') {
+        if (used < TTY_BUF_SIZE) {
+            tty->buf[tty->tail++ % TTY_BUF_SIZE] = c;
+            tty->line_end = tty->tail;
+            tty_echo(tty, &c, 1);
+            scheduler_wake_all(&tty->readers);
+        }
+    } else if (used < TTY_BUF_SIZE - 1) {
+        /* the last byte is kept for the newline */
+        tty->buf[tty->tail++ % TTY_BUF_SIZE] = c;
+        tty_echo(tty, &c, 1);
+    }
+
+    spin_unlock_irqrestore(&tty->lock, flags);
+}
+
+static int tty_open(vnode_t *n)
+{
+    UNUSED_ARGUMENT(n);
+
+    return 0;
+}
+
+static int tty_lookup(vnode_t *n, char const *p, vnode_t *o)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(p);
+    UNUSED_ARGUMENT(o);
+
+    return -1;
+}
+
+/* Blocks until a line has been entered, then returns at most count bytes of
+ * it. The rest of a line that didn't fit is returned by the next read.
+ */
+static int tty_read(vnode_t *n, void *buf, size_t count, uint32_t offset)
+{
+    tty_t *tty = (tty_t *) n->v_data;
+    ps_t *ps = scheduler_get_current_process();
+    char *b = buf, c;
+    size_t i = 0;
+    uint32_t flags;
+
+    UNUSED_ARGUMENT(offset);
+
+    if (count == 0) {
+        return 0;
+    }
+
+    flags = spin_lock_irqsave(&tty->lock);
+    while (tty->head == tty->line_end) {
+        if (ps == NULL) {
+            spin_unlock_irqrestore(&tty->lock, flags);
+            return -1;
+        }
+
+        scheduler_prepare_wait(&tty->readers);
+        spin_unlock_irqrestore(&tty->lock, flags);
+        ps->rusage.nvcsw++;
+        snapshot_and_schedule(&ps->current);
+        flags = spin_lock_irqsave(&tty->lock);
+    }
+
+    while (i < count && tty->head != tty->line_end) {
+        c = tty->buf[tty->head++ % TTY_BUF_SIZE];
+        b[i++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&tty->lock, flags);
+
+    return i;
+}
+
+static int tty_write(vnode_t *n, char const *buf, size_t count)
+{
+    tty_t *tty = (tty_t *) n->v_data;
+    return tty->output(tty, buf, count);
+}
+
+static int tty_getattr(vnode_t *n, vattr_t *attr)
+{
+    UNUSED_ARGUMENT(n);
+    UNUSED_ARGUMENT(attr);
+
+    return -1;
+}
+
+void tty_init(tty_t *tty, char const *name, tty_output_t output,
+              char const *erase, uint32_t data)
+{
+    spinlock_t lock = SPINLOCK_INIT("tty");
+    wait_queue_t readers = WAIT_QUEUE_INIT;
+
+    tty->name = name;
+    tty->output = output;
+    tty->erase = erase;
+    tty->data = data;
+    tty->head = 0;
+    tty->line_end = 0;
+    tty->tail = 0;
+    tty->readers = readers;
+    tty->lock = lock;
+    tty->lock.name = name;
+
+    vnodeops.vn_open = &tty_open;
+    vnodeops.vn_lookup = &tty_lookup;
+    vnodeops.vn_read = &tty_read;
+    vnodeops.vn_write = &tty_write;
+    vnodeops.vn_getattr = &tty_getattr;
+}
+
+int tty_get_vnode(tty_t *tty, vnode_t *out)
+{
+    out->v_op = &vnodeops;
+    out->v_data = (uint32_t) tty;
+
+    return 0;
+}
+
+static int console_output(tty_t *tty, char const *buf, size_t len)
+{
+    UNUSED_ARGUMENT(tty);
+
+    return fb_write_buf(buf, len);
+}
+
+void tty_console_init(void)
+{
+    /* the frame buffer erases the character on a backspace */
+    tty_init(&console, "tty", &console_output, "\b", 0);
+}
+
+void tty_console_input(char c)
+{
+    tty_input(&console, c);
+}
+
+int tty_console_get_vnode(vnode_t *out)
+{
+    return tty_get_vnode(&console, out);
+}
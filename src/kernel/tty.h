@@ -0,0 +1,54 @@
+#ifndef TTY_H
+#define TTY_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "vnode.h"
+#include "spinlock.h"
+#include "scheduler.h"
+
+/* A terminal between a character device and the processes that use it. The
+ * input is edited a line at a time (canonical mode) and echoed by the kernel,
+ * reads block until a whole line has been entered.
+ */
+
+#define TTY_BUF_SIZE 256 /* must be a power of two */
+
+struct tty;
+/* writes to the device, returns the number of bytes written */
+typedef int (*tty_output_t)(struct tty *tty, char const *buf, size_t len);
+
+struct tty {
+    char const *name;
+    tty_output_t output;
+    char const *erase;      /* echoed when a character is erased */
+    uint32_t data;          /* for the driver, e.g. the port */
+
+    /* the indices are free running, [head, line_end) holds the complete
+     * lines that can be read, [line_end, tail) the line being edited */
+    char buf[TTY_BUF_SIZE];
+    uint32_t head;
+    uint32_t line_end;
+    uint32_t tail;
+
+    wait_queue_t readers;
+    spinlock_t lock;
+};
+typedef struct tty tty_t;
+
+void tty_init(tty_t *tty, char const *name, tty_output_t output,
+              char const *erase, uint32_t data);
+
+/* Feeds a character received by the device to the line discipline, called
+ * by the driver's bottom half.
+ */
+void tty_input(tty_t *tty, char c);
+
+int tty_get_vnode(tty_t *tty, vnode_t *out);
+
+/* the tty on the screen and the keyboard, /dev/tty */
+void tty_console_init(void);
+void tty_console_input(char c);
+int tty_console_get_vnode(vnode_t *out);
+
+#endif /* TTY_H */
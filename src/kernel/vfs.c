@@ -1,109 +1,202 @@
+#define LOG_SUBSYSTEM LOG_SUBSYS_FS
+
 #include "vfs.h"
 #include "string.h"
 #include "log.h"
 #include "kmalloc.h"
+#include "spinlock.h"
+#include "dcache.h"
+
+/* The mount points are kept in a trie keyed by path components, the root is
+ * "/". Finding the file system for a path walks down the trie as far as the
+ * path goes and picks the deepest node that has something mounted.
+ */
+struct mount_node {
+    struct mount_node *children;
+    struct mount_node *sibling;
+    char const *name;
+    uint32_t len;
+    vfs_t *vfs;         /* NULL if nothing is mounted here */
+};
+typedef struct mount_node mount_node_t;
+
+static mount_node_t mount_root = { NULL, NULL, "", 0, NULL };
+static spinlock_t vfs_lock = SPINLOCK_INIT("vfs");
+
+/* @return The length of the component that p points at, after skipping the
+ *         slashes in front of it */
+static uint32_t next_component(char const **p)
+{
+    while (**p == '/') {
+        ++*p;
+    }
+    return strcspn(*p, "/");
+}
+
+/* called with vfs_lock held */
+static mount_node_t *find_child(mount_node_t *node, char const *name,
+                                uint32_t len)
+{
+    mount_node_t *child;
+    for (child = node->children; child != NULL; child = child->sibling) {
+        if (child->len == len && strncmp(child->name, name, len) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/* called with vfs_lock held */
+static mount_node_t *add_child(mount_node_t *node, char const *name,
+                               uint32_t len)
+{
+    mount_node_t *child = kmalloc(sizeof(mount_node_t));
+    char *copy = kmalloc(len + 1);
+
+    if (child == NULL || copy == NULL) {
+        log_error("add_child", "Could not allocate a mount node\n");
+        kfree(child);
+        kfree(copy);
+        return NULL;
+    }
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    child->children = NULL;
+    child->sibling = node->children;
+    child->name = copy;
+    child->len = len;
+    child->vfs = NULL;
+    node->children = child;
 
-static vfs_t *vfs_list = NULL;
+    return child;
+}
 
 int vfs_mount(char const *path, vfs_t *vfs)
 {
-    if (vfs_list == NULL) {
-        vfs_list = vfs;
-    } else {
-        vfs_t *i = vfs_list;
-        while (i->vfs_next != NULL) {
-            if (strcmp(i->mount_path, path) == 0) {
+    mount_node_t *node = &mount_root, *child;
+    char const *p = path;
+    uint32_t flags, len;
+
+    if (path[0] != '/') {
+        return -1;
+    }
+
+    flags = spin_lock_irqsave(&vfs_lock);
+    while ((len = next_component(&p)) != 0) {
+        child = find_child(node, p, len);
+        if (child == NULL) {
+            /* the nodes added so far are harmless if this fails */
+            child = add_child(node, p, len);
+            if (child == NULL) {
+                spin_unlock_irqrestore(&vfs_lock, flags);
                 return -1;
             }
-            i = i->vfs_next;
         }
-        i->vfs_next = vfs;
+        node = child;
+        p += len;
     }
 
-    int plen = strlen(path) + 1;
-    char *p = kmalloc(plen * sizeof(char));
-    memcpy(p, path, plen);
-    vfs->mount_path = p;
-    vfs->vfs_next = NULL;
+    if (node->vfs != NULL) {
+        spin_unlock_irqrestore(&vfs_lock, flags);
+        log_error("vfs_mount", "Something is already mounted at %s\n", path);
+        return -1;
+    }
+    node->vfs = vfs;
+    spin_unlock_irqrestore(&vfs_lock, flags);
 
     return 0;
 }
 
-static int find_longest_mount_path(char const *path, vfs_t **out)
+/* @return The file system with the deepest mount point on the path, or NULL,
+ *         rest is set to the part of the path below the mount point */
+static vfs_t *find_mount(char const *path, char const **rest)
 {
-    vfs_t *i = vfs_list;
-    vfs_t *root;
-    uint32_t max_len = 0, idx;
-    while (i != NULL) {
-        char const *mp = i->mount_path;
-        char const *p = path;
-        for (idx = 0; *p && *mp && *p == *mp; ++p, ++mp, ++idx) {
+    mount_node_t *node = &mount_root;
+    vfs_t *vfs = mount_root.vfs;
+    char const *p = path;
+    uint32_t flags, len;
+
+    *rest = path;
+
+    flags = spin_lock_irqsave(&vfs_lock);
+    while ((len = next_component(&p)) != 0) {
+        node = find_child(node, p, len);
+        if (node == NULL) {
+            break;
         }
-        if (idx > max_len) {
-            root = i;
-            max_len = idx;
+        p += len;
+        if (node->vfs != NULL) {
+            vfs = node->vfs;
+            *rest = p;
         }
-        i = i->vfs_next;
     }
+    spin_unlock_irqrestore(&vfs_lock, flags);
 
-    *out = root;
-    return max_len;
-
+    return vfs;
 }
 
-int vfs_lookup(char const *path, vnode_t *res)
+/* Resolves one component, name is the len first characters of the rest of
+ * the path. dir and res must not be the same vnode.
+ */
+static int lookup_component(vnode_t *dir, char const *name, uint32_t len,
+                            vnode_t *res)
 {
-    if (strlen(path) < 1) {
-        return -1;
+    char buf[VFS_NAME_MAX + 1];
+    int ret;
+
+    switch (dcache_lookup(dir, name, len, res)) {
+        case DCACHE_HIT:
+            return 0;
+        case DCACHE_NEGATIVE:
+            return -1;
     }
 
-    if (path[0] != '/') {
+    if (len > VFS_NAME_MAX) {
         return -1;
     }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
 
+    ret = dir->v_op->vn_lookup(dir, buf, res);
+    dcache_insert(dir, name, len, ret == 0 ? res : NULL);
 
+    return ret;
+}
+
+/* Walks the path in place, one component at a time, without copying it */
+int vfs_lookup(char const *path, vnode_t *res)
+{
     vfs_t *root;
-    int max_len = find_longest_mount_path(path, &root);
-    path += max_len;
+    vnode_t dir, node;
+    char const *p;
+    uint32_t len;
 
-    vnode_t vnode;
-    if (root->vfs_op->vfs_root(root, &vnode)) {
-        log_error("vfs_lookup", "Could not find vnode for path %s\n", path);
+    if (path[0] != '/') {
         return -1;
     }
 
-    if (strlen(path) == 0) {
-        res->v_op = vnode.v_op;
-        res->v_data = vnode.v_data;
-        return 0;
+    root = find_mount(path, &p);
+    if (root == NULL) {
+        log_error("vfs_lookup", "Nothing is mounted for path %s\n", path);
+        return -1;
     }
 
-    int ret = 0, inc;
-    uint32_t slash_index;
-    char *p = kmalloc(strlen(path) * sizeof(char) + 1);
-    char *orgp = p;
-    memcpy(p, path, strlen(path) + 1);
-
-    while (strlen(p) != 0 && ret == 0) {
-        slash_index = strcspn(p, "/");
+    if (root->vfs_op->vfs_root(root, &node)) {
+        log_error("vfs_lookup", "Could not find vnode for path %s\n", path);
+        return -1;
+    }
 
-        if (slash_index != strlen(p)) {
-            p[slash_index] = '\0';
-            inc = slash_index + 1;
-        } else {
-            inc = slash_index;
+    while ((len = next_component(&p)) != 0) {
+        vnode_copy(&node, &dir);
+        if (lookup_component(&dir, p, len, &node)) {
+            return -1;
         }
-
-        ret = vnode.v_op->vn_lookup(&vnode, p, res);
-        vnode.v_op = res->v_op;
-        vnode.v_data = res->v_data;
-
-        p += inc;
+        p += len;
     }
 
-    kfree(orgp);
-
-    return ret;
+    vnode_copy(&node, res);
+    return 0;
 }
 
 int vfs_open(vnode_t *node)
@@ -111,9 +204,9 @@ int vfs_open(vnode_t *node)
     return node->v_op->vn_open(node);
 }
 
-int vfs_read(vnode_t *node, void *buf, uint32_t count)
+int vfs_read(vnode_t *node, void *buf, uint32_t count, uint32_t offset)
 {
-    return node->v_op->vn_read(node, buf, count);
+    return node->v_op->vn_read(node, buf, count, offset);
 }
 
 int vfs_write(vnode_t *node, char const *str, size_t len)
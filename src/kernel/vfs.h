@@ -5,12 +5,20 @@
 #include "vnode.h"
 #include "vattr.h"
 
+/* whence for lseek */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* the longest name of a file, i.e. of a component of a path */
+#define VFS_NAME_MAX 255
+/* the longest path, including the NUL, that a syscall accepts */
+#define VFS_PATH_MAX 1024
+
 struct vfsops;
 
 struct vfs {
-    struct vfs *vfs_next;
     struct vfsops *vfs_op;
-    char const *mount_path;
     uint32_t vfs_data;
 };
 typedef struct vfs vfs_t;
@@ -23,7 +31,7 @@ typedef struct vfsops vfsops_t;
 int vfs_mount(char const *path, vfs_t *vfs);
 int vfs_lookup(char const *path, vnode_t *res);
 int vfs_open(vnode_t *node);
-int vfs_read(vnode_t *node, void *buf, uint32_t count);
+int vfs_read(vnode_t *node, void *buf, uint32_t count, uint32_t offset);
 int vfs_write(vnode_t *node, char const *str, size_t len);
 int vfs_getattr(vnode_t *node, vattr_t *attr);
 
@@ -16,7 +16,8 @@ typedef struct vnode vnode_t;
 struct vnodeops {
     int (*vn_open)(vnode_t *node);
     int (*vn_lookup)(vnode_t *dir, char const *name, vnode_t *res);
-    int (*vn_read)(vnode_t *node, void *buf, size_t count);
+    /* the offset is ignored by devices that don't have a position */
+    int (*vn_read)(vnode_t *node, void *buf, size_t count, uint32_t offset);
     int (*vn_write)(vnode_t *node, char const *buf, size_t count);
     int (*vn_getattr)(vnode_t *node, vattr_t *attr);
 };
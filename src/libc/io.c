@@ -0,0 +1,13 @@
+#include "unistd.h"
+#include "sys/syscall.h"
+
+int lseek(int fd, int offset, int whence)
+{
+    return syscall(SYS_lseek, fd, offset, whence);
+}
+
+int pread(int fd, void *buf, uint32_t count, uint32_t offset)
+{
+    /* SYSENTER only passes on three arguments */
+    return syscall_int(SYS_pread, fd, buf, count, offset);
+}
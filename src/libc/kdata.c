@@ -0,0 +1,17 @@
+#include "sys/kdata.h"
+#include "unistd.h"
+
+uint32_t kdata_uptime(void)
+{
+    return ((struct kdata *) KDATA_VADDR)->uptime;
+}
+
+uint32_t getpid(void)
+{
+    return ((struct kdata_ps *) KDATA_PS_VADDR)->pid;
+}
+
+uint32_t getppid(void)
+{
+    return ((struct kdata_ps *) KDATA_PS_VADDR)->ppid;
+}
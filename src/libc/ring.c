@@ -0,0 +1,60 @@
+#include "sys/ring.h"
+#include "sys/syscall.h"
+#include "unistd.h"
+#include "stddef.h"
+
+int ring_init(struct ring *ring, uint32_t entries)
+{
+    int vaddr = syscall(SYS_ring_setup, entries);
+    if (vaddr == -1) {
+        return -1;
+    }
+
+    ring->shared = (struct ring_shared *) vaddr;
+    ring->sqes = (struct ring_sqe *) (vaddr + ring->shared->sqes_offset);
+    ring->cqes = (struct ring_cqe *) (vaddr + ring->shared->cqes_offset);
+    ring->mask = ring->shared->entries - 1;
+    ring->sq_tail = ring->shared->sq_tail;
+
+    return 0;
+}
+
+struct ring_sqe *ring_get_sqe(struct ring *ring)
+{
+    struct ring_sqe *sqe;
+
+    if (ring->sq_tail - ring->shared->sq_head > ring->mask) {
+        return NULL;
+    }
+
+    sqe = &ring->sqes[ring->sq_tail & ring->mask];
+    ++ring->sq_tail;
+
+    return sqe;
+}
+
+int ring_submit(struct ring *ring)
+{
+    uint32_t to_submit = ring->sq_tail - ring->shared->sq_head;
+
+    /* the kernel only looks at the ring during SYS_ring_enter, so the
+     * entries are in place by the time it reads the tail */
+    ring->shared->sq_tail = ring->sq_tail;
+
+    return syscall(SYS_ring_enter, to_submit);
+}
+
+struct ring_cqe *ring_peek_cqe(struct ring *ring)
+{
+    uint32_t head = ring->shared->cq_head;
+    if (head == ring->shared->cq_tail) {
+        return NULL;
+    }
+
+    return &ring->cqes[head & ring->mask];
+}
+
+void ring_cqe_seen(struct ring *ring)
+{
+    ring->shared->cq_head++;
+}
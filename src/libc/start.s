@@ -7,6 +7,7 @@ SYS_exit equ 6
 
 section .text
 align 4
+    sub  esp, 20    ; syscall always reads five arguments, keep them mapped
     call main
     push eax        ; eax is the status code from main, send it to exit
     push SYS_exit
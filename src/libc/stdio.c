@@ -0,0 +1,89 @@
+#include "stdio.h"
+#include "stdarg.h"
+#include "stdint.h"
+#include "unistd.h"
+#include "sys/syscall.h"
+
+#define PRINTF_BUFFER_SIZE 256
+
+struct printf_buffer {
+    char data[PRINTF_BUFFER_SIZE];
+    uint32_t len;
+};
+typedef struct printf_buffer printf_buffer_t;
+
+static void put_b(printf_buffer_t *b, char c)
+{
+    if (b->len < PRINTF_BUFFER_SIZE) {
+        b->data[b->len++] = c;
+    }
+}
+
+static void put_ui(printf_buffer_t *b, uint32_t i)
+{
+    char digits[10];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + i % 10;
+        i /= 10;
+    } while (i > 0);
+
+    while (n > 0) {
+        put_b(b, digits[--n]);
+    }
+}
+
+static void put_ui_hex(printf_buffer_t *b, uint32_t n)
+{
+    char *chars = "0123456789ABCDEF";
+    int i;
+
+    put_b(b, '0');
+    put_b(b, 'x');
+
+    for (i = 7; i >= 0; --i) {
+        put_b(b, chars[(n >> i*4) & 0x0F]);
+    }
+}
+
+int printf(char const *fmt, ...)
+{
+    va_list ap;
+    char const *p;
+    char const *sval;
+    printf_buffer_t b;
+
+    b.len = 0;
+
+    va_start(ap, fmt);
+    for (p = fmt; *p != '\0'; ++p) {
+        if (*p != '%') {
+            put_b(&b, *p);
+            continue;
+        }
+
+        switch (*++p) {
+            case 'c':
+                put_b(&b, (char) va_arg(ap, uint32_t));
+                break;
+            case 'u':
+                put_ui(&b, va_arg(ap, uint32_t));
+                break;
+            case 'X':
+                put_ui_hex(&b, va_arg(ap, uint32_t));
+                break;
+            case 's':
+                for (sval = va_arg(ap, char const *); *sval; ++sval) {
+                    put_b(&b, *sval);
+                }
+                break;
+            case '%':
+                put_b(&b, '%');
+                break;
+        }
+    }
+    va_end(ap);
+
+    return syscall(SYS_write, STDOUT_FILENO, b.data, b.len);
+}
@@ -0,0 +1,23 @@
+#ifndef STDIO_H
+#define STDIO_H
+
+#define STDIN_FILENO    0
+#define STDOUT_FILENO   1
+#define STDERR_FILENO   2
+
+/*
+ * Prints a formatted string to STDOUT_FILENO with a single write syscall.
+ * The supported types are the same as for printf in the kernel:
+ *  - %c: Prints a char
+ *  - %u: Prints an unsigned int
+ *  - %X: Prints an unsigned int as a hexadecimal number in capital letters
+ *  - %s: Prints a char *
+ *  - %%: Prints the character %
+ *
+ * Output longer than the internal buffer (256 bytes) is truncated.
+ *
+ * @return The number of characters written, or -1 on error
+ */
+int printf(char const *fmt, ...);
+
+#endif /* STDIO_H */
@@ -0,0 +1,26 @@
+#ifndef KDATA_H
+#define KDATA_H
+
+#include "stdint.h"
+
+/* Read-only pages that the kernel maps into every process, see
+ * kernel/kdata.h. Reading them doesn't need a syscall.
+ */
+
+#define KDATA_VADDR     0x3FFFE000
+#define KDATA_PS_VADDR  0x3FFFF000
+
+/* must be kept in sync with kernel/kdata.h */
+struct kdata {
+    volatile uint32_t uptime;       /* time since the scheduler started, ms */
+} __attribute__((packed));
+
+struct kdata_ps {
+    volatile uint32_t pid;
+    volatile uint32_t ppid;
+} __attribute__((packed));
+
+/* the time since the scheduler started, in ms */
+uint32_t kdata_uptime(void);
+
+#endif /* KDATA_H */
@@ -0,0 +1,14 @@
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include "stdint.h"
+
+/* must be kept in sync with struct rusage in kernel/process.h */
+struct rusage {
+    uint32_t utime;     /* time spent in user mode, in ms */
+    uint32_t stime;     /* time spent in kernel mode, in ms */
+    uint32_t nvcsw;     /* voluntary context switches */
+    uint32_t nivcsw;    /* involuntary context switches */
+} __attribute__((packed));
+
+#endif /* RESOURCE_H */
@@ -0,0 +1,53 @@
+#ifndef RING_H
+#define RING_H
+
+#include "stdint.h"
+
+/* A submission and a completion queue shared with the kernel, see
+ * kernel/ring.h. Queue syscalls with ring_get_sqe, submit them all with one
+ * ring_submit and collect the results with ring_peek_cqe/ring_cqe_seen.
+ */
+
+#define RING_MAX_ARGS 3
+
+/* must be kept in sync with kernel/ring.h */
+struct ring_sqe {
+    uint32_t opcode;                /* the syscall number */
+    uint32_t args[RING_MAX_ARGS];
+    uint32_t user_data;             /* copied to the completion */
+} __attribute__((packed));
+
+struct ring_cqe {
+    uint32_t user_data;
+    int res;                        /* the return value of the syscall */
+} __attribute__((packed));
+
+struct ring_shared {
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+    uint32_t sqes_offset;
+    uint32_t cqes_offset;
+} __attribute__((packed));
+
+struct ring {
+    struct ring_shared *shared;
+    struct ring_sqe *sqes;
+    struct ring_cqe *cqes;
+    uint32_t mask;
+    uint32_t sq_tail;               /* queued, but not yet submitted */
+};
+
+/* entries must be a power of two, at most 128 */
+int ring_init(struct ring *ring, uint32_t entries);
+/* @return The next free submission entry, or NULL if the queue is full */
+struct ring_sqe *ring_get_sqe(struct ring *ring);
+/* @return The number of submissions the kernel consumed */
+int ring_submit(struct ring *ring);
+/* @return The oldest unseen completion, or NULL if there is none */
+struct ring_cqe *ring_peek_cqe(struct ring *ring);
+void ring_cqe_seen(struct ring *ring);
+
+#endif /* RING_H */
@@ -0,0 +1,18 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "stdint.h"
+
+#define SCHED_NORMAL    0
+#define SCHED_RT        1
+#define SCHED_EDF       2
+
+/* must be kept in sync with struct sched_param in kernel/process.h */
+struct sched_param {
+    uint32_t policy;
+    int priority;       /* nice value for SCHED_NORMAL, 0-31 for SCHED_RT */
+    uint32_t period;    /* SCHED_EDF only, in ms */
+    uint32_t budget;    /* SCHED_EDF only, in ms per period */
+} __attribute__((packed));
+
+#endif /* SCHED_H */
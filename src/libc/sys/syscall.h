@@ -9,5 +9,12 @@
 #define SYS_yield   5
 #define SYS_exit    6
 #define SYS_wait    7
+#define SYS_getrusage 8
+#define SYS_setpriority 9
+#define SYS_ring_setup 10
+#define SYS_ring_enter 11
+#define SYS_lseek   12
+#define SYS_pread   13
+#define SYS_getpids 14  /* (uint32_t *pids, uint32_t count), at most 64 */
 
 #endif /* SYSCALL_H */
@@ -0,0 +1,11 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include "stdint.h"
+
+/* Reads the time stamp counter, i.e. the number of cycles since reset.
+ * Defined in tsc.s
+ */
+uint64_t tsc_read(void);
+
+#endif /* TSC_H */
@@ -0,0 +1,9 @@
+[bits 32]
+
+global tsc_read
+
+section .text
+align 4
+tsc_read:
+    rdtsc               ; loads the time stamp counter into edx:eax
+    ret                 ; a 64 bit value is returned in edx:eax by cdecl
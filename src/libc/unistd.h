@@ -1,6 +1,27 @@
 #ifndef UNISTD_H
 #define UNISTD_H
 
+#include "stdint.h"
+
 int syscall(int number, ...);
 
+/* whence for SYS_lseek */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* @return The new offset, or -1 */
+int lseek(int fd, int offset, int whence);
+/* Reads from offset without moving the file's offset */
+int pread(int fd, void *buf, uint32_t count, uint32_t offset);
+
+/* syscall uses the fastest way into the kernel, these force one of them */
+int syscall_int(int number, ...);
+int syscall_sysenter(int number, ...);
+int syscall_has_sysenter(void);
+
+/* read from the kdata page, see sys/kdata.h */
+uint32_t getpid(void);
+uint32_t getppid(void);
+
 #endif /* UNISTD_H */
@@ -1,15 +1,88 @@
 [bits 32]
 
 global syscall
+global syscall_int
+global syscall_sysenter
+global syscall_has_sysenter
+
+CPUID_FEATURE_SEP   equ 1 << 11
+
+section .data
+align 4
+; 0 if not checked yet, 1 if SYSENTER can be used, 2 if it can't
+sysenter_state: dd 0
 
 section .text
 align 4
 ; syscall
-; - Performs a syscall, the stack has to be set up in advance. If the C
-;   syscall declaration is used in unistd.h, the stack will be correct
-;   due to the cdecl calling convention
+; - Performs a syscall with the number in eax and the arguments in ebx, ecx,
+;   edx, esi and edi. Since the number of arguments isn't known, all five are
+;   read from the stack. Uses SYSENTER if the CPU has it.
 syscall:
-    add esp, 4	; do not send the return address to the kernel
-    int 0xAE	; trap into the kernel
-    sub esp, 4	; restore the return address (given that kernel didn't fuck up)
+    mov eax, [sysenter_state]
+    cmp eax, 1
+    je  syscall_sysenter    ; jmp, so that the stack is left as it is
+    cmp eax, 2
+    je  syscall_int
+    call syscall_has_sysenter
+    jmp syscall
+
+; syscall_int
+; - Performs a syscall with int 0xAE, takes the same arguments as syscall
+syscall_int:
+    push ebx            ; ebx, esi and edi are callee saved
+    push esi
+    push edi
+    mov eax, [esp+16]   ; the syscall number
+    mov ebx, [esp+20]
+    mov ecx, [esp+24]
+    mov edx, [esp+28]
+    mov esi, [esp+32]
+    mov edi, [esp+36]
+    int 0xAE            ; trap into the kernel
+    pop edi
+    pop esi
+    pop ebx
+    ret
+
+; syscall_sysenter
+; - Performs a syscall with SYSENTER, takes the same arguments as syscall but
+;   only the first three are passed on. ecx and edx are used for the esp and
+;   eip to return to, so the second and third argument go in esi and edi.
+syscall_sysenter:
+    push ebx
+    push esi
+    push edi
+    mov eax, [esp+16]   ; the syscall number
+    mov ebx, [esp+20]
+    mov esi, [esp+24]
+    mov edi, [esp+28]
+    mov ecx, esp
+    mov edx, .return
+    sysenter
+.return:
+    pop edi
+    pop esi
+    pop ebx
+    ret
+; syscall_has_sysenter
+; - Returns 1 if the CPU supports SYSENTER, 0 otherwise
+syscall_has_sysenter:
+    mov eax, [sysenter_state]
+    test eax, eax
+    jnz .known
+    push ebx            ; cpuid clobbers ebx, which is callee saved
+    mov eax, 1          ; leaf 1: processor info and feature bits
+    cpuid
+    pop ebx
+    mov eax, 2
+    test edx, CPUID_FEATURE_SEP
+    jz .store
+    mov eax, 1
+.store:
+    mov [sysenter_state], eax
+.known:
+    cmp eax, 1
+    sete al
+    movzx eax, al
     ret
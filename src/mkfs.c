@@ -122,6 +122,7 @@ static void write_superblock(uint16_t num_inodes, uint16_t start_block_offset)
     sb->num_inodes = num_inodes;
     sb->start_block = start_block_offset;
     sb->magic_number = AEFS_MAGIC_NUMBER;
+    sb->features = AEFS_FEATURE_HASHED_DIRS;
 }
 
 static uint16_t visit_dir(char *path, int is_root)
@@ -129,7 +130,7 @@ static uint16_t visit_dir(char *path, int is_root)
     DIR *dir;
     uint32_t i;
     struct dirent *ent;
-    uint32_t num_files = 0;
+    uint32_t num_files = 0, entries_size = 0, name_len, hash, offset;
     char *child_path;
     uint16_t child_inode_id;
     struct stat st;
@@ -152,7 +153,13 @@ static uint16_t visit_dir(char *path, int is_root)
             strcmp(ent->d_name, "..") == 0) {
             continue;
         }
+        name_len = strlen(ent->d_name);
+        if (name_len > AEFS_FILENAME_MAX_LEN) {
+            fprintf(stderr, "ERROR: File name too long: %s\n", ent->d_name);
+            exit(1);
+        }
         num_files++;
+        entries_size += AEFS_HDIRENTRY_SIZE(name_len);
     }
 
     if (is_root) {
@@ -166,18 +173,32 @@ static uint16_t visit_dir(char *path, int is_root)
         die("ERROR: Too many inodes required");
     }
 
-    uint32_t blocks_required = div_ceil(num_files*sizeof(aefs_direntry_t),
-                                        AEFS_BLOCK_SIZE);
+    /* at most one entry per bucket on average */
+    uint32_t num_buckets = 1;
+    while (num_buckets < num_files) {
+        num_buckets <<= 1;
+    }
+
+    uint32_t dir_size = sizeof(aefs_dirheader_t) +
+                        num_buckets * sizeof(uint32_t) + entries_size;
+    uint32_t blocks_required = div_ceil(dir_size, AEFS_BLOCK_SIZE);
+    /* the blocks of a directory must be consecutive */
     uint16_t dir_start_block_id = next_block_id;
     next_block_id += blocks_required;
     block_t *dir_start_block = start_block + dir_start_block_id;
 
     memset(dir_start_block, 0, AEFS_BLOCK_SIZE * blocks_required);
-    aefs_direntry_t *entries = (aefs_direntry_t *) dir_start_block;
+    char *dir_data = (char *) dir_start_block;
+    aefs_dirheader_t *header = (aefs_dirheader_t *) dir_data;
+    uint32_t *buckets = (uint32_t *) (header + 1);
+    aefs_hdirentry_t *entry;
+
+    header->num_entries = num_files;
+    header->num_buckets = num_buckets;
+    offset = sizeof(aefs_dirheader_t) + num_buckets * sizeof(uint32_t);
 
     rewinddir(dir);
 
-    i = 0;
     while ((ent = readdir(dir)) != NULL) {
         if (strcmp(ent->d_name, ".") == 0 ||
             strcmp(ent->d_name, "..") == 0) {
@@ -197,13 +218,25 @@ static uint16_t visit_dir(char *path, int is_root)
             fprintf(stderr, "ERROR: Unsupported file type: %s", child_path);
             exit(1);
         }
-        entries[i].inode_id = child_inode_id;
-        strncpy(entries[i].name, ent->d_name, AEFS_FILENAME_MAX_LEN);
-        ++i;
+
+        name_len = strlen(ent->d_name);
+        hash = AEFS_HASH_INIT;
+        for (i = 0; i < name_len; ++i) {
+            hash = AEFS_HASH_STEP(hash, ent->d_name[i]);
+        }
+
+        entry = (aefs_hdirentry_t *) (dir_data + offset);
+        entry->hash = hash;
+        entry->inode_id = child_inode_id;
+        entry->name_len = name_len;
+        memcpy(entry->name, ent->d_name, name_len + 1);
+
+        entry->next = buckets[hash & (num_buckets - 1)];
+        buckets[hash & (num_buckets - 1)] = offset;
+        offset += AEFS_HDIRENTRY_SIZE(name_len);
     }
 
     dir_inode->type = AEFS_FILETYPE_DIR;
-    uint32_t dir_size = sizeof(aefs_direntry_t) * num_files;
     fill_inode_size(dir_inode, dir_size);
 
     fill_inode_blocks(dir_inode, blocks_required, dir_start_block_id);
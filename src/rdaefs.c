@@ -27,6 +27,7 @@ typedef struct block block_t;
 
 static block_t *file;
 static uint16_t num_inodes;
+static uint32_t features;
 static block_t *block_start;
 
 void read_superblock()
@@ -36,8 +37,10 @@ void read_superblock()
     printf("\tmagic_number: %X\n", sb->magic_number);
     printf("\tnum_inodes: %hu\n", sb->num_inodes);
     printf("\tstart_block: %hu\n", sb->start_block);
+    printf("\tfeatures: %X\n", sb->features);
     printf("\n");
     num_inodes = sb->num_inodes;
+    features = sb->features;
     block_start = file + sb->start_block;
 }
 
@@ -99,8 +102,45 @@ void visit_reg(aefs_inode_t *inode, char const *path)
     print_inode(inode);
 }
 
+void visit_hashed_dir(aefs_inode_t *inode, char const *path)
+{
+    char const *dir = (char const *) (block_start + inode->blocks[0]);
+    aefs_dirheader_t const *header = (aefs_dirheader_t const *) dir;
+    aefs_hdirentry_t const *entry;
+    uint32_t i, offset;
+
+    printf("-> DIR: %s (%u entries, %u buckets)\n", path,
+           header->num_entries, header->num_buckets);
+    print_inode(inode);
+
+    char *child_path = malloc(strlen(path) + AEFS_FILENAME_MAX_LEN + 1);
+    if (child_path == NULL) {
+        die("ERROR: Out of memory");
+    }
+
+    /* the entries follow the buckets back to back */
+    offset = sizeof(aefs_dirheader_t) + header->num_buckets * sizeof(uint32_t);
+    for (i = 0; i < header->num_entries; ++i) {
+        entry = (aefs_hdirentry_t const *) (dir + offset);
+        printf("\t\t-> ENTRY: %s -> %hu (hash %X, bucket %u)\n",
+               entry->name, entry->inode_id, entry->hash,
+               entry->hash & (header->num_buckets - 1));
+
+        sprintf(child_path, "%s/%s", path, entry->name);
+        visit_inode(get_inode(entry->inode_id), child_path);
+        offset += AEFS_HDIRENTRY_SIZE(entry->name_len);
+    }
+
+    free(child_path);
+}
+
 void visit_dir(aefs_inode_t *inode, char const *path)
 {
+    if (features & AEFS_FEATURE_HASHED_DIRS) {
+        visit_hashed_dir(inode, path);
+        return;
+    }
+
     int num_entries = AEFS_INODE_SIZE(inode)/sizeof(aefs_direntry_t);
     int i;
     aefs_direntry_t *entry;